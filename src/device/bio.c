@@ -0,0 +1,143 @@
+#include "bio.h"
+#include "blkdev.h"
+#include "ide.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "sync.h"
+#include "debug.h"
+#include "cpu.h"
+#include "iostat.h"
+
+/** 两段扇区是否重叠 */
+static bool bio_overlap(struct bio* a, struct bio* b) {
+    return a->lba < b->lba + b->sec_cnt && b->lba < a->lba + a->sec_cnt;
+}
+
+/** 队列中与 bio 冲突(扇区重叠且至少一方是写)的请求，没有返回 NULL。需关中断 */
+static struct bio* bio_find_conflict(struct disk* hd, struct bio* bio) {
+    struct list_elem* elem = hd->bio_queue.head.next;
+    while (elem != &hd->bio_queue.tail) {
+        struct bio* queued = elem2entry(struct bio, queue_tag, elem);
+        if ((queued->write || bio->write) && bio_overlap(queued, bio)) {
+            return queued;
+        }
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/** 硬盘的异步提交：按起始扇区插入请求队列，唤醒通道的派发线程。
+ * 电梯算法会打乱提交顺序，所以与已排队请求冲突时先等它出队，保证读到写入的数据。
+ * 同一通道的命令按出队顺序逐条执行，出队后就不会再被超越 */
+void elv_submit(struct bio* bio) {
+    struct disk* hd = bdev_to_disk(bio->bdev);
+    enum intr_status old_status = intr_disable();
+    while (bio_find_conflict(hd, bio) != NULL) {
+        wait_queue_sleep(&hd->bdev.bio_done, 0);
+    }
+    // 按起始扇区插入，相同扇区的排在后面，保持提交顺序
+    struct list_elem* elem = hd->bio_queue.head.next;
+    while (elem != &hd->bio_queue.tail) {
+        struct bio* queued = elem2entry(struct bio, queue_tag, elem);
+        if (queued->lba > bio->lba) {
+            break;
+        }
+        elem = elem->next;
+    }
+    list_insert_before(elem, &bio->queue_tag);
+    hd->nr_inflight++;
+    bio->submit_tsc = rdtsc();
+    iostat_submit(&hd->stats, hd->nr_inflight);
+    struct partition* part = disk_part_of(hd, bio->lba);
+    if (part != NULL) {
+        iostat_submit(&part->stats, hd->nr_inflight);
+    }
+    intr_set_status(old_status);
+    wake_up(&hd->my_channel->bio_pending);
+}
+
+/** C-LOOK：取起始扇区不小于磁头位置的第一个请求，没有就绕回最小的。需关中断 */
+static struct bio* elv_next(struct disk* hd) {
+    struct list_elem* elem = hd->bio_queue.head.next;
+    while (elem != &hd->bio_queue.tail) {
+        struct bio* bio = elem2entry(struct bio, queue_tag, elem);
+        if (bio->lba >= hd->head_lba) {
+            return bio;
+        }
+        elem = elem->next;
+    }
+    return elem2entry(struct bio, queue_tag, hd->bio_queue.head.next);
+}
+
+/** 从 first 起把扇区首尾相接、方向相同的请求摘下放进 batch，合起来用一条命令下发。返回总扇区数。需关中断 */
+static uint32_t elv_merge(struct disk* hd, struct bio* first, struct list* batch) {
+    uint32_t sec_cnt = 0, nr = 0;
+    struct list_elem* elem = &first->queue_tag;
+    while (elem != &hd->bio_queue.tail && nr < BIO_MAX_MERGE) {
+        struct bio* bio = elem2entry(struct bio, queue_tag, elem);
+        if (bio->write != first->write || bio->lba != first->lba + sec_cnt ||
+            sec_cnt + bio->sec_cnt > hd->max_secs) {
+            break;
+        }
+        elem = elem->next;
+        list_remove(&bio->queue_tag);
+        list_append(batch, &bio->batch_tag);
+        sec_cnt += bio->sec_cnt;
+        nr++;
+    }
+    return sec_cnt;
+}
+
+/** 通道的派发线程：两块硬盘的队列轮流取，每次按 C-LOOK 选一批下发，等硬盘中断唤醒后完成这批请求 */
+static void blk_dispatcher(void* arg) {
+    struct ide_channel* channel = arg;
+    uint8_t dev_no = 0;
+    struct list batch;
+    while (1) {
+        enum intr_status old_status = intr_disable();
+        while (list_empty(&channel->devices[0].bio_queue) && list_empty(&channel->devices[1].bio_queue)) {
+            wait_queue_sleep(&channel->bio_pending, 0);
+        }
+        if (list_empty(&channel->devices[dev_no].bio_queue)) {
+            dev_no ^= 1;
+        }
+        struct disk* hd = &channel->devices[dev_no];
+        dev_no ^= 1;
+        list_init(&batch);
+        struct bio* first = elv_next(hd);
+        uint32_t lba = first->lba;
+        bool write = first->write;
+        uint32_t sec_cnt = elv_merge(hd, first, &batch);
+        hd->head_lba = lba + sec_cnt;
+        intr_set_status(old_status);
+
+        int32_t status = ide_transfer(hd, &batch, lba, sec_cnt, write);
+        uint64_t now = rdtsc();
+
+        while (!list_empty(&batch)) {
+            struct bio* bio = elem2entry(struct bio, batch_tag, list_pop(&batch));
+            // bio_endio 之后提交者可能已经释放了 bio，先记统计
+            iostat_bio_done(&hd->stats, bio, status, now);
+            struct partition* part = disk_part_of(hd, bio->lba);
+            if (part != NULL) {
+                iostat_bio_done(&part->stats, bio, status, now);
+            }
+            old_status = intr_disable();
+            hd->nr_inflight--;
+            intr_set_status(old_status);
+            bio_endio(bio, status);
+        }
+    }
+}
+
+/** 初始化通道上两块硬盘的请求队列并启动通道的派发线程 */
+void bio_channel_init(struct ide_channel* channel) {
+    wait_queue_init(&channel->bio_pending);
+    for (uint8_t dev_no = 0; dev_no < 2; dev_no++) {
+        struct disk* hd = &channel->devices[dev_no];
+        list_init(&hd->bio_queue);
+        hd->head_lba = 0;
+        hd->nr_inflight = 0;
+    }
+    thread_start("blkd", BLKD_PRIO, blk_dispatcher, channel);
+}
@@ -0,0 +1,37 @@
+#ifndef __DEVICE_BIO_H
+#define __DEVICE_BIO_H
+#include "stdint.h"
+#include "list.h"
+#include "global.h"
+
+#define BIO_MAX_SECS    256     // 一个 bio 最多的扇区数
+#define BIO_MAX_MERGE   64      // 一次最多合并下发的 bio 数，保证 DMA 描述符表够用
+#define BLKD_PRIO       31      // 派发线程的优先级
+
+struct block_device;
+struct ide_channel;
+struct bio;
+
+typedef void bio_end_fn(struct bio* bio);
+
+/* 一次块读写请求。硬盘的请求在队列里按扇区排序，由通道的派发线程下发 */
+struct bio {
+    struct list_elem queue_tag;     // 硬盘请求队列中的结点
+    struct list_elem batch_tag;     // 合并下发时本批请求中的结点
+    struct block_device* bdev;
+    uint32_t lba;
+    uint32_t sec_cnt;               // 1 ~ BIO_MAX_SECS
+    void* buf;
+    uint32_t* pgdir;                // buf 在用户空间时提交者的页表，派发线程借它搬数据
+    bool write;
+    bool done;
+    int32_t status;                 // 完成后的结果，0 成功，-1 失败
+    uint64_t submit_tsc;            // 进入硬盘请求队列的时刻，用于统计延迟
+    bio_end_fn* end_io;             // 完成回调，可为 NULL。硬盘的请求在派发线程中调用
+    void* private;                  // 留给 end_io 用
+};
+
+void elv_submit(struct bio* bio);
+void bio_channel_init(struct ide_channel* channel);
+
+#endif
@@ -0,0 +1,147 @@
+#include "blkdev.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "string.h"
+#include "stdio-kernel.h"
+#include "debug.h"
+
+#define BLK_RW_BATCH    4       // blk_rw 一次提交的 bio 数
+
+struct list bdev_list;          // 所有注册的块设备
+
+/** 以 name 登记块设备 */
+void bdev_register(struct block_device* bdev, const char* name, const struct block_ops* ops) {
+    ASSERT(strlen(name) < sizeof(bdev->name));
+    strcpy(bdev->name, name);
+    bdev->ops = ops;
+    wait_queue_init(&bdev->bio_done);
+    list_append(&bdev_list, &bdev->bdev_tag);
+}
+
+/** 按名字找块设备，没有返回 NULL */
+struct block_device* bdev_find(const char* name) {
+    struct list_elem* elem = bdev_list.head.next;
+    while (elem != &bdev_list.tail) {
+        struct block_device* bdev = elem2entry(struct block_device, bdev_tag, elem);
+        if (!strcmp(bdev->name, name)) {
+            return bdev;
+        }
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/** 读写前检查扇区范围 */
+static bool bdev_range_ok(struct block_device* bdev, uint32_t lba, uint32_t sec_cnt) {
+    uint32_t capacity = bdev->ops->capacity(bdev);
+    return sec_cnt > 0 && lba < capacity && sec_cnt <= capacity - lba;
+}
+
+/** 从 bdev 读 sec_cnt 个扇区到 buf，成功返回 0，失败返回 -1 */
+int32_t bdev_read(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+    if (!bdev_range_ok(bdev, lba, sec_cnt)) {
+        printk("%s: read beyond end, lba %d sec_cnt %d\n", bdev->name, lba, sec_cnt);
+        return -1;
+    }
+    return bdev->ops->read(bdev, lba, buf, sec_cnt);
+}
+
+/** 把 buf 中 sec_cnt 个扇区写到 bdev，成功返回 0，失败返回 -1 */
+int32_t bdev_write(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+    if (!bdev_range_ok(bdev, lba, sec_cnt)) {
+        printk("%s: write beyond end, lba %d sec_cnt %d\n", bdev->name, lba, sec_cnt);
+        return -1;
+    }
+    return bdev->ops->write(bdev, lba, buf, sec_cnt);
+}
+
+/** 等此前写入的数据落到介质上，设备没有缓存时直接返回 0 */
+int32_t bdev_flush(struct block_device* bdev) {
+    return bdev->ops->flush != NULL ? bdev->ops->flush(bdev) : 0;
+}
+
+/** 设备的总扇区数 */
+uint32_t bdev_capacity(struct block_device* bdev) {
+    return bdev->ops->capacity(bdev);
+}
+
+/** 初始化一个读写 bdev 上 [lba, lba+sec_cnt) 的请求 */
+void bio_init(struct bio* bio, struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt, bool write) {
+    ASSERT(sec_cnt > 0 && sec_cnt <= BIO_MAX_SECS);
+    bio->bdev = bdev;
+    bio->lba = lba;
+    bio->sec_cnt = sec_cnt;
+    bio->buf = buf;
+    bio->pgdir = (uint32_t)buf < KERNEL_SPACE ? running_thread()->pgdir : NULL;
+    bio->write = write;
+    bio->done = false;
+    bio->status = 0;
+    bio->end_io = NULL;
+    bio->private = NULL;
+}
+
+/** 提交请求后立即返回，完成时置 done、调用 end_io 并唤醒 bio_wait。
+ * 设备没有异步提交时就地同步读写 */
+void bio_submit(struct bio* bio) {
+    struct block_device* bdev = bio->bdev;
+    if (bdev->ops->submit != NULL) {
+        bdev->ops->submit(bio);
+        return;
+    }
+    int32_t status = bio->write ? bdev->ops->write(bdev, bio->lba, bio->buf, bio->sec_cnt)
+                                : bdev->ops->read(bdev, bio->lba, bio->buf, bio->sec_cnt);
+    bio_endio(bio, status);
+}
+
+/** 由设备在请求完成时调用：记下结果，调用 end_io，唤醒等待者。
+ * 等待者共用设备的 bio_done，别的请求完成时也会被唤醒，一看到 done 就可能返回并释放 bio，
+ * 所以先取出要用的成员，关中断后再置 done，之后不再碰 bio */
+void bio_endio(struct bio* bio, int32_t status) {
+    struct block_device* bdev = bio->bdev;
+    bio->status = status;
+    if (bio->end_io != NULL) {
+        bio->end_io(bio);
+    }
+    enum intr_status old_status = intr_disable();
+    bio->done = true;
+    wake_up_all(&bdev->bio_done);
+    intr_set_status(old_status);
+}
+
+/** 等待请求完成，返回其结果 */
+int32_t bio_wait(struct bio* bio) {
+    enum intr_status old_status = intr_disable();
+    while (!bio->done) {
+        wait_queue_sleep(&bio->bdev->bio_done, 0);
+    }
+    intr_set_status(old_status);
+    return bio->status;
+}
+
+/** 同步读写任意数量的扇区：拆成 bio 成批提交后一起等待。成功返回 0，任一部分失败返回 -1 */
+int32_t blk_rw(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt, bool write) {
+    struct bio bios[BLK_RW_BATCH];
+    int32_t ret = 0;
+    uint32_t secs_done = 0;
+    while (secs_done < sec_cnt) {
+        uint32_t nr = 0;
+        while (nr < BLK_RW_BATCH && secs_done < sec_cnt) {
+            uint32_t secs_op = sec_cnt - secs_done < BIO_MAX_SECS ? sec_cnt - secs_done : BIO_MAX_SECS;
+            bio_init(&bios[nr], bdev, lba + secs_done, (uint8_t*)buf + secs_done * 512, secs_op, write);
+            bio_submit(&bios[nr]);
+            secs_done += secs_op;
+            nr++;
+        }
+        for (uint32_t i = 0; i < nr; i++) {
+            if (bio_wait(&bios[i]) != 0) {
+                ret = -1;
+            }
+        }
+    }
+    return ret;
+}
+
+/** 在各块设备驱动登记之前调用 */
+void blkdev_init(void) {
+    list_init(&bdev_list);
+}
@@ -0,0 +1,45 @@
+#ifndef __DEVICE_BLKDEV_H
+#define __DEVICE_BLKDEV_H
+#include "stdint.h"
+#include "list.h"
+#include "sync.h"
+#include "bio.h"
+#include "global.h"
+
+struct block_device;
+
+/* 块设备的操作。read/write 同步读写，成功返回 0，失败返回 -1 */
+struct block_ops {
+    int32_t (*read)(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt);
+    int32_t (*write)(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt);
+    int32_t (*flush)(struct block_device* bdev);    // 把设备缓存写到介质上，可为 NULL
+    uint32_t (*capacity)(struct block_device* bdev);// 总扇区数
+    void (*submit)(struct bio* bio);                // 异步提交，可为 NULL，此时 bio_submit 就地同步完成
+};
+
+/* 块设备：硬盘、阵列、内存盘等都嵌入这个结构，文件系统只通过它读写 */
+struct block_device {
+    char name[8];
+    const struct block_ops* ops;
+    struct wait_queue bio_done;     // 等待本设备请求完成的线程
+    struct list_elem bdev_tag;      // 所有块设备队列中的结点
+};
+
+extern struct list bdev_list;
+
+void bdev_register(struct block_device* bdev, const char* name, const struct block_ops* ops);
+struct block_device* bdev_find(const char* name);
+int32_t bdev_read(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt);
+int32_t bdev_write(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt);
+int32_t bdev_flush(struct block_device* bdev);
+uint32_t bdev_capacity(struct block_device* bdev);
+
+void bio_init(struct bio* bio, struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt, bool write);
+void bio_submit(struct bio* bio);
+void bio_endio(struct bio* bio, int32_t status);
+int32_t bio_wait(struct bio* bio);
+int32_t blk_rw(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt, bool write);
+
+void blkdev_init(void);
+
+#endif
@@ -7,6 +7,10 @@
 #include "string.h"
 #include "io.h"
 #include "timer.h"
+#include "pci.h"
+#include "bio.h"
+#include "global.h"
+#include "cpu.h"
 
 /* 定义硬盘各寄存器的端口号 */
 #define reg_data(channel)       (channel->port_base + 0)
@@ -21,10 +25,22 @@
 #define reg_alt_status(channel) (channel->port_base + 0x206)
 #define reg_ctl(channel)        reg_alt_status(channel)
 
+/* 总线主控 DMA 寄存器，主通道在 BAR4 处，从通道再加 8 */
+#define reg_bm_cmd(channel)     (channel->bm_base + 0)
+#define reg_bm_status(channel)  (channel->bm_base + 2)
+#define reg_bm_prdt(channel)    (channel->bm_base + 4)
+
 /* reg_alt_status寄存器的一些关键位 */
 #define BIT_STAT_BSY    0x80        // 硬盘忙
 #define BIT_STAT_DRDY   0x40        // 驱动器准备好
 #define BIT_STAT_DRQ    0x8         // 数据传输准备好了
+#define BIT_STAT_ERR    0x1         // 上一条命令出错
+
+/* DMA 命令、状态寄存器的位 */
+#define BM_CMD_START    0x1         // 启动传输，清零则停止
+#define BM_CMD_READ     0x8         // 方向：硬盘到内存
+#define BM_STATUS_ERR   0x2         // 传输出错，写 1 清除
+#define BM_STATUS_INTR  0x4         // 硬盘发出了中断，写 1 清除
 
 /* device寄存器的一些关键位 */
 #define BIT_DEV_MBS     0xa0        // 第7位和第5位固定为1
@@ -35,6 +51,27 @@
 #define CMD_IDENTIFY        0xec    // identify指令
 #define CMD_READ_SECTOR     0x20    // 读扇区指令
 #define CMD_WRITE_SECTOR    0x30    // 写扇区指令
+#define CMD_READ_DMA        0xc8    // DMA 读扇区
+#define CMD_WRITE_DMA       0xca    // DMA 写扇区
+#define CMD_READ_MULTI      0xc4    // 读扇区，每个数据块 multi_secs 个扇区、一次中断
+#define CMD_WRITE_MULTI     0xc5    // 写扇区，同上
+#define CMD_SET_MULTI       0xc6    // 设置 READ/WRITE MULTIPLE 的数据块大小
+#define CMD_FLUSH_CACHE     0xe7    // 把硬盘缓存写到盘片上
+#define CMD_READ_SECTOR_EXT 0x24    // 以下为 LBA48 版本
+#define CMD_WRITE_SECTOR_EXT 0x34
+#define CMD_READ_DMA_EXT    0x25
+#define CMD_WRITE_DMA_EXT   0x35
+#define CMD_READ_MULTI_EXT  0x29
+#define CMD_WRITE_MULTI_EXT 0x39
+#define CMD_FLUSH_CACHE_EXT 0xea
+
+#define LBA28_MAX_SECS      (1 << 28)   // 28 位 LBA 可寻址的扇区数，即 128GB
+#define IDE_MULTI_SECS      16          // READ/WRITE MULTIPLE 每块的扇区数上限
+#define IDE_MAX_SECS        256         // 一条 LBA28 命令的扇区数上限
+#define IDE_MAX_SECS_LBA48  1024        // 一条 LBA48 命令合并的扇区数上限，受 DMA 描述符表一页的限制
+#define IDE_PIO32           1           // 设备支持时 PIO 用 32 位 insl/outsl，置 0 则总用 16 位
+
+#define IDE_TIMEOUT_MS      5000    // 一条命令从发出到完成的最长时间
 
 uint8_t channel_cnt;                // 按硬盘数计算的通道数
 struct ide_channel channels[2];     // 有两个ide通道。假设主板上只有一对主次通道
@@ -58,6 +95,15 @@ struct partition_table_entry {
     uint32_t sec_cnt;       // 本分区的扇区数目
 } __attribute__ ((packed)); // 保证此结构 16字节 
 
+/** 物理区域描述符，描述一段物理上连续、不跨 64KB 边界的内存 */
+struct prd {
+    uint32_t phys_addr;
+    uint16_t byte_cnt;      // 0 表示 64KB
+    uint16_t flags;
+} __attribute__ ((packed));
+
+#define PRD_EOT 0x8000      // 表中最后一项
+
 /** 引导扇区，mbr或ebr所在的扇区 */
 struct boot_sector {
     uint8_t  other[446];    // 引导代码
@@ -75,41 +121,86 @@ static void select_disk(struct disk* hd) {
     outb(reg_dev(hd->my_channel), reg_device);
 }
 
-/** 1.1 向硬盘控制器写入 起始扇区地址 及要读写的 扇区数(0 for 256) */
-static void select_sector(struct disk* hd, uint32_t lba, uint8_t sec_cnt) {    
+/** 超出 28 位 LBA 的寻址范围或一次超过 256 个扇区时要用 LBA48 命令 */
+static bool need_lba48(uint32_t lba, uint32_t sec_cnt) {
+    return sec_cnt > IDE_MAX_SECS || lba + sec_cnt > LBA28_MAX_SECS;
+}
+
+/** 1.1 向硬盘控制器写入 起始扇区地址 及要读写的 扇区数。
+ * LBA28 的扇区数 0 表示 256；LBA48 每个寄存器先写高字节再写低字节，扇区数 0 表示 65536 */
+static void select_sector(struct disk* hd, uint32_t lba, uint32_t sec_cnt, bool lba48) {
     struct ide_channel* channel = hd->my_channel;
-    // sec_cnt为0则表示写入256个扇区
+    uint8_t dev = BIT_DEV_MBS | BIT_DEV_LBA | (hd->dev_no == 1 ? BIT_DEV_DEV : 0);
+    if (lba48) {
+        outb(reg_sect_cnt(channel), sec_cnt >> 8);
+        outb(reg_lba_l(channel), lba >> 24);     // 24~31位
+        outb(reg_lba_m(channel), 0);             // 32~47位，lba 只有 32 位
+        outb(reg_lba_h(channel), 0);
+        outb(reg_sect_cnt(channel), sec_cnt);
+        outb(reg_lba_l(channel), lba);
+        outb(reg_lba_m(channel), lba >> 8);
+        outb(reg_lba_h(channel), lba >> 16);
+        outb(reg_dev(channel), dev);
+        return;
+    }
+    // sec_cnt为256时写入0
     outb(reg_sect_cnt(channel), sec_cnt);
     // lba地址低8位(不需单独取出低8位，指令 outb %b0, %w1 只用al)
     outb(reg_lba_l(channel), lba);
     outb(reg_lba_m(channel), lba >> 8);      // 8~15位
     outb(reg_lba_h(channel), lba >> 16);     // 16~23位
     // lba地址24~27位存储在device寄存器的0～3位
-    outb(reg_dev(channel), BIT_DEV_MBS | BIT_DEV_LBA | (hd->dev_no == 1 ? BIT_DEV_DEV : 0) | lba >> 24);
+    outb(reg_dev(channel), dev | lba >> 24);
+}
+
+/** 按传输方式和寻址方式选读写命令 */
+static uint8_t rw_cmd(struct disk* hd, bool dma, bool lba48, bool write) {
+    if (dma) {
+        return lba48 ? (write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT) : (write ? CMD_WRITE_DMA : CMD_READ_DMA);
+    }
+    if (hd->multi_secs > 1) {
+        return lba48 ? (write ? CMD_WRITE_MULTI_EXT : CMD_READ_MULTI_EXT) : (write ? CMD_WRITE_MULTI : CMD_READ_MULTI);
+    }
+    return lba48 ? (write ? CMD_WRITE_SECTOR_EXT : CMD_READ_SECTOR_EXT) : (write ? CMD_WRITE_SECTOR : CMD_READ_SECTOR);
 }
 
-/** 2 发出命令（磁盘开始工作）*/
+/** 2 发出命令（磁盘开始工作）。要等这条命令的中断时先 expect_intr */
 static void cmd_out(struct ide_channel* channel, uint8_t cmd) {
-    // 只要向硬盘发出了命令 便将此标记置为true，硬盘中断处理程序需要根据它来判断
-    channel->expecting_intr = true;
     outb(reg_cmd(channel), cmd);
 }
 
-/** 3
- a 读：执行 P操作，等待硬盘读数据到硬盘缓冲区，完成后产生中断，中断返回后等待硬盘响应，最多31秒，然后搬数据到内存 
- b 写：等待硬盘响应，把数据写到硬盘缓冲区，P操作，等待硬盘把缓冲区的数据写到磁盘，完成后中断、返回
- */
-static bool busy_wait(struct disk* hd) {
-    struct ide_channel* channel = hd->my_channel;
-    uint16_t time_limit = 30 * 1000;      // 可以等待30000毫秒
-    while (time_limit -= 10 >= 0) {
-        if (!(inb(reg_status(channel)) & BIT_STAT_BSY)) {
-            return (inb(reg_status(channel)) & BIT_STAT_DRQ);
-        } else {
-            msleep(10);            // 睡眠10毫秒
+/** 标记期待硬盘的中断，中断处理程序据此判断中断是否属于本次命令。须在硬盘可能发出中断之前调用 */
+static void expect_intr(struct ide_channel* channel) {
+    channel->expecting_intr = true;
+}
+
+/** 3 等待中断处理程序读到本次命令完成的状态，最迟到 deadline 嘀嗒。
+ * 状态存于 channel->status；超时返回 false 并不再期待这次中断 */
+static bool wait_intr(struct ide_channel* channel, uint32_t deadline) {
+    enum intr_status old_status = intr_disable();
+    while (channel->expecting_intr) {
+        int32_t left = (int32_t)(deadline - ticks);
+        if (left <= 0) {
+            break;
         }
+        wait_queue_sleep(&channel->intr_wait, left);
     }
-    return false;
+    bool done = !channel->expecting_intr;
+    channel->expecting_intr = false;
+    intr_set_status(old_status);
+    return done;
+}
+
+/** 开着中断轮询状态寄存器直到硬盘不忙，返回状态，最迟到 deadline 嘀嗒，超时视为出错。
+ * 只用于 PIO 写的第一块：硬盘准备好接收数据时不发中断 */
+static uint8_t poll_status(struct ide_channel* channel, uint32_t deadline) {
+    uint8_t status;
+    while ((status = inb(reg_status(channel))) & BIT_STAT_BSY) {
+        if ((int32_t)(deadline - ticks) <= 0) {
+            return BIT_STAT_ERR;
+        }
+    }
+    return status;
 }
 
 /** 缓冲区 -> 内存，sec_cnt 个扇区 */
@@ -120,8 +211,11 @@ static void read_from_sector(struct disk* hd, void* buf, uint8_t sec_cnt) {
     } else {
         size_in_byte = sec_cnt * 512;
     }
-    // 字长 16
-    insw(reg_data(hd->my_channel), buf, size_in_byte / 2);
+    if (hd->pio32) {
+        insl(reg_data(hd->my_channel), buf, size_in_byte / 4);
+    } else {
+        insw(reg_data(hd->my_channel), buf, size_in_byte / 2);
+    }
 }
 
 /** 内存 -> 缓冲区，sec_cnt 个扇区 */
@@ -132,74 +226,244 @@ static void write2sector(struct disk* hd, void* buf, uint8_t sec_cnt) {
     } else {
         size_in_byte = sec_cnt * 512;
     }
-    outsw(reg_data(hd->my_channel), buf, size_in_byte / 2);
+    if (hd->pio32) {
+        outsl(reg_data(hd->my_channel), buf, size_in_byte / 4);
+    } else {
+        outsw(reg_data(hd->my_channel), buf, size_in_byte / 2);
+    }
 }
  
-/* 从硬盘读取sec_cnt个扇区到buf */
-void ide_read(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt) {
-   
-    ASSERT(sec_cnt > 0);
-    mutex_lock(&hd->my_channel->lock);
-    
-    select_disk(hd); // 1.0
-    
-    uint32_t secs_op;         // 每次操作的扇区数
-    uint32_t secs_done = 0;   // 已完成的扇区数
-    while(secs_done < sec_cnt) {  // 硬盘一次最多操作256个扇区，可能分多次读
-        if ((secs_done + 256) <= sec_cnt) {
-            secs_op = 256;
-        } else {
-            secs_op = sec_cnt - secs_done;
+/** buf 能否直接用于 DMA：要在内核空间(所有页表中映射相同)且按字对齐 */
+static bool dma_usable(struct disk* hd, void* buf) {
+    return hd->dma && (uint32_t)buf >= KERNEL_SPACE && (uint32_t)buf % 2 == 0;
+}
+
+/** 整批请求能否用 DMA：每个缓冲区都要满足 dma_usable */
+static bool batch_dma_usable(struct disk* hd, struct list* batch) {
+    struct list_elem* elem = batch->head.next;
+    while (elem != &batch->tail) {
+        struct bio* bio = elem2entry(struct bio, batch_tag, elem);
+        if (!dma_usable(hd, bio->buf)) {
+            return false;
         }
-    
-        select_sector(hd, lba + secs_done, secs_op);    // 1.1
-        cmd_out(hd->my_channel, CMD_READ_SECTOR);       // 2 
-        sema_p(&hd->my_channel->disk_done);             // 3
-        if (!busy_wait(hd)) {  // 没有响应，一般是修不好的，如硬盘炸了，PANIC
-            char error[64]; sprintf(error, "%s read sector %d failed!!!!!!\n", hd->name, lba);
-            PANIC(error);
+        elem = elem->next;
+    }
+    return true;
+}
+
+/** 按页把 batch 中各请求的缓冲区依次拆成物理区域填进描述符表。
+ * 一页不会跨 64KB 边界；512KB 分在至多 64 个请求里，最多用 128 + 2*64 项，一页放得下 */
+static void prdt_fill(struct ide_channel* channel, struct list* batch) {
+    struct prd* prd = channel->prdt;
+    struct list_elem* elem = batch->head.next;
+    while (elem != &batch->tail) {
+        struct bio* bio = elem2entry(struct bio, batch_tag, elem);
+        uint32_t vaddr = (uint32_t)bio->buf;
+        uint32_t bytes = bio->sec_cnt * 512;
+        while (bytes > 0) {
+            uint32_t chunk = PG_SIZE - (vaddr & (PG_SIZE - 1));
+            if (chunk > bytes) {
+                chunk = bytes;
+            }
+            prd->phys_addr = addr_v2p(vaddr);
+            prd->byte_cnt = chunk;
+            prd->flags = 0;
+            vaddr += chunk;
+            bytes -= chunk;
+            prd++;
         }
-        // 4.a 从驱动器缓冲区读到内存
-        read_from_sector(hd, (void*)((uint32_t)buf + secs_done * 512), secs_op);
-        secs_done += secs_op;
+        elem = elem->next;
     }
-    mutex_unlock(&hd->my_channel->lock);
+    (prd - 1)->flags = PRD_EOT;
 }
 
-/* 将buf中sec_cnt扇区数据写入硬盘 */
-void ide_write(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt) {
-   
-    ASSERT(sec_cnt > 0);
-    mutex_lock(&hd->my_channel->lock);
-    
-    select_disk(hd);
-    
-    uint32_t secs_op;         // 每次操作的扇区数
-    uint32_t secs_done = 0;   // 已完成的扇区数
-    while(secs_done < sec_cnt) {
-        if ((secs_done + 256) <= sec_cnt) {
-            secs_op = 256;
+/** 用总线主控 DMA 读写 sec_cnt 个扇区，数据分散在 batch 的各个缓冲区中。
+ * 传输期间 cpu 不参与，完成时由中断唤醒。成功返回 true */
+static bool dma_transfer(struct disk* hd, struct list* batch, uint32_t lba, uint32_t sec_cnt, bool write, uint32_t deadline) {
+    struct ide_channel* channel = hd->my_channel;
+    uint8_t dir = write ? 0 : BM_CMD_READ;
+    prdt_fill(channel, batch);
+    outl(reg_bm_prdt(channel), addr_v2p((uint32_t)channel->prdt));
+    outb(reg_bm_cmd(channel), dir);     // 先停下并设好方向
+    outb(reg_bm_status(channel), BM_STATUS_ERR | BM_STATUS_INTR);
+
+    bool lba48 = need_lba48(lba, sec_cnt);
+    select_sector(hd, lba, sec_cnt, lba48);
+    expect_intr(channel);
+    cmd_out(channel, rw_cmd(hd, true, lba48, write));
+    outb(reg_bm_cmd(channel), dir | BM_CMD_START);
+
+    if (!wait_intr(channel, deadline)) {
+        outb(reg_bm_cmd(channel), dir);     // 超时，停下 DMA 引擎
+        return false;
+    }
+    return !(channel->bm_status & BM_STATUS_ERR) && !(channel->status & BIT_STAT_ERR);
+}
+
+/* 一条 PIO 命令的进度：数据块可能横跨两个请求的缓冲区 */
+struct pio_progress {
+    struct list_elem* elem; // 正在搬的请求在 batch 中的结点
+    uint32_t sec_off;       // 该请求已搬的扇区数
+    uint32_t secs_left;     // 本条命令还没搬的扇区数
+};
+
+/** 搬一个数据块 sec_cnt 个扇区，依次落在各请求的缓冲区中。
+ * 只在搬运期间关中断。缓冲区在用户空间时只在提交者的页表里有映射，关中断临时换上它的页表，搬完换回 */
+static void pio_move_block(struct disk* hd, struct pio_progress* prog, uint32_t sec_cnt, bool write) {
+    while (sec_cnt > 0) {
+        struct bio* bio = elem2entry(struct bio, batch_tag, prog->elem);
+        uint32_t secs = bio->sec_cnt - prog->sec_off < sec_cnt ? bio->sec_cnt - prog->sec_off : sec_cnt;
+        uint8_t* buf = (uint8_t*)bio->buf + prog->sec_off * 512;
+        uint32_t old_cr3 = 0;
+        enum intr_status old_status = intr_disable();
+        if (bio->pgdir != NULL) {
+            asm volatile ("movl %%cr3, %0" : "=r" (old_cr3));
+            asm volatile ("movl %0, %%cr3" : : "r" (addr_v2p((uint32_t)bio->pgdir)) : "memory");
+        }
+        if (write) {
+            write2sector(hd, buf, secs);
         } else {
-            secs_op = sec_cnt - secs_done;
+            read_from_sector(hd, buf, secs);
+        }
+        if (bio->pgdir != NULL) {
+            asm volatile ("movl %0, %%cr3" : : "r" (old_cr3) : "memory");
+        }
+        intr_set_status(old_status);
+
+        sec_cnt -= secs;
+        prog->secs_left -= secs;
+        prog->sec_off += secs;
+        if (prog->sec_off == bio->sec_cnt) {
+            prog->elem = prog->elem->next;
+            prog->sec_off = 0;
+        }
+    }
+}
+
+/** PIO 读写 sec_cnt 个扇区，按 batch 中的顺序逐个搬运各请求的数据。成功返回 true。
+ * 硬盘设了 multi_secs 时用 READ/WRITE MULTIPLE，每块 multi_secs 个扇区只就绪一次、中断一次。
+ * 读：每块就绪时有中断，等到后搬这一块；写：第一块轮询就绪，之后每块写完等中断，最后一块的中断表示命令完成。
+ * 还会有中断的块在搬运前就开始期待，搬运时关着中断，中断不会在期待之前到来 */
+static bool pio_transfer(struct disk* hd, struct list* batch, uint32_t lba, uint32_t sec_cnt, bool write, uint32_t deadline) {
+    struct ide_channel* channel = hd->my_channel;
+    bool lba48 = need_lba48(lba, sec_cnt);
+    select_sector(hd, lba, sec_cnt, lba48);                         // 1.1
+    if (!write) {
+        expect_intr(channel);
+    }
+    cmd_out(channel, rw_cmd(hd, false, lba48, write));              // 2
+    uint8_t status = write ? poll_status(channel, deadline) : 0;
+    struct pio_progress prog = {batch->head.next, 0, sec_cnt};
+    while (prog.secs_left > 0) {                                    // 3 逐块等就绪 4 搬数据
+        if (!write) {
+            if (!wait_intr(channel, deadline)) {
+                return false;
+            }
+            status = channel->status;
+        }
+        if ((status & (BIT_STAT_DRQ | BIT_STAT_ERR)) != BIT_STAT_DRQ) {
+            return false;
         }
-         
-        select_sector(hd, lba + secs_done, secs_op); 
-        cmd_out(hd->my_channel, CMD_WRITE_SECTOR);    
-        if (!busy_wait(hd)) { 
-            char error[64];
-            sprintf(error, "%s write sector %d failed!!!!!!\n", hd->name, lba);
-            PANIC(error);
+        uint32_t block = hd->multi_secs < prog.secs_left ? hd->multi_secs : prog.secs_left;
+        if (write || block < prog.secs_left) {
+            expect_intr(channel);
         }
-         
-        write2sector(hd, (void*)((uint32_t)buf + secs_done * 512), secs_op);
-        // 硬盘开始工作
-        sema_p(&hd->my_channel->disk_done);
-        secs_done += secs_op;
-    }
-    /* 醒来后开始释放锁*/
-    mutex_unlock(&hd->my_channel->lock);
+        pio_move_block(hd, &prog, block, write);
+        if (write) {
+            if (!wait_intr(channel, deadline)) {
+                return false;
+            }
+            status = channel->status;
+        }
+    }
+    return !(status & BIT_STAT_ERR);
+}
+
+/** 硬盘上包含扇区 lba 的分区，不在任何分区中返回 NULL */
+struct partition* disk_part_of(struct disk* hd, uint32_t lba) {
+    for (uint8_t i = 0; i < 12; i++) {
+        struct partition* part = i < 4 ? &hd->prim_parts[i] : &hd->logic_parts[i - 4];
+        if (part->sec_cnt != 0 && lba >= part->start_lba && lba - part->start_lba < part->sec_cnt) {
+            return part;
+        }
+    }
+    return NULL;
+}
+
+/** 用一条命令读写 [lba, lba+sec_cnt)，sec_cnt 不超过 hd->max_secs，数据依次分布在 batch 的各请求中。
+ * 由通道的派发线程调用，整条命令限时 IDE_TIMEOUT_MS。成功返回 0，硬盘无响应或出错返回 -1 */
+int32_t ide_transfer(struct disk* hd, struct list* batch, uint32_t lba, uint32_t sec_cnt, bool write) {
+    ASSERT(sec_cnt > 0 && sec_cnt <= hd->max_secs);
+    struct ide_channel* channel = hd->my_channel;
+    uint64_t lock_start = rdtsc();
+    mutex_lock(&channel->lock);
+    uint64_t service_start = rdtsc();
+    uint32_t deadline = ticks + ms_to_ticks(IDE_TIMEOUT_MS);
+    select_disk(hd);    // 1.0
+    bool ok;
+    if (batch_dma_usable(hd, batch)) {
+        ok = dma_transfer(hd, batch, lba, sec_cnt, write, deadline);
+    } else {
+        ok = pio_transfer(hd, batch, lba, sec_cnt, write, deadline);
+    }
+    if (!ok) {
+        printk("%s %s sector %d failed!\n", hd->name, write ? "write" : "read", lba);
+    }
+    mutex_unlock(&channel->lock);
+
+    uint64_t lock_wait = service_start - lock_start, service = rdtsc() - service_start;
+    iostat_cmd_done(&hd->stats, lock_wait, service);
+    struct partition* part = disk_part_of(hd, lba);
+    if (part != NULL) {
+        iostat_cmd_done(&part->stats, lock_wait, service);
+    }
+    return ok ? 0 : -1;
+}
+
+/* 从硬盘读取sec_cnt个扇区到buf，成功返回0，硬盘无响应返回-1。请求经队列由派发线程下发 */
+static int32_t ide_read(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+    return blk_rw(bdev, lba, buf, sec_cnt, false);
+}
+
+/* 将buf中sec_cnt扇区数据写入硬盘，成功返回0，硬盘无响应返回-1 */
+static int32_t ide_write(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+    return blk_rw(bdev, lba, buf, sec_cnt, true);
+}
+
+/** 等已提交的请求都完成后用 FLUSH CACHE 把硬盘缓存写到盘片上，成功返回 0 */
+static int32_t ide_flush(struct block_device* bdev) {
+    struct disk* hd = bdev_to_disk(bdev);
+    struct ide_channel* channel = hd->my_channel;
+    enum intr_status old_status = intr_disable();
+    while (hd->nr_inflight > 0) {
+        wait_queue_sleep(&bdev->bio_done, 0);
+    }
+    intr_set_status(old_status);
+
+    mutex_lock(&channel->lock);
+    select_disk(hd);
+    expect_intr(channel);
+    cmd_out(channel, hd->lba48 ? CMD_FLUSH_CACHE_EXT : CMD_FLUSH_CACHE);
+    bool ok = wait_intr(channel, ticks + ms_to_ticks(IDE_TIMEOUT_MS)) && !(channel->status & BIT_STAT_ERR);
+    mutex_unlock(&channel->lock);
+    if (!ok) {
+        printk("%s flush cache failed!\n", hd->name);
+    }
+    return ok ? 0 : -1;
+}
+
+static uint32_t ide_capacity(struct block_device* bdev) {
+    return bdev_to_disk(bdev)->sectors;
 }
 
+static const struct block_ops ide_ops = {
+    .read = ide_read,
+    .write = ide_write,
+    .flush = ide_flush,
+    .capacity = ide_capacity,
+    .submit = elv_submit
+};
+
 /** 将dst中len个相邻字节交换位置后存入buf。读数据时字长为单位，而相邻字节位置是互换的 */
 static void swap_pairs_bytes(const char* dst, char* buf, uint32_t len) {
     uint8_t idx;
@@ -211,14 +475,33 @@ static void swap_pairs_bytes(const char* dst, char* buf, uint32_t len) {
     buf[idx] = '\0';
 }
 
+/** 用 SET MULTIPLE MODE 把每块的扇区数设为 max_multi 与 IDE_MULTI_SECS 中较小的一个，
+ * 硬盘不支持或设置失败时 multi_secs 为 1，用普通的读写扇区命令 */
+static void set_multiple(struct disk* hd, uint8_t max_multi) {
+    struct ide_channel* channel = hd->my_channel;
+    hd->multi_secs = 1;
+    if (max_multi < 2) {
+        return;
+    }
+    uint8_t multi = max_multi < IDE_MULTI_SECS ? max_multi : IDE_MULTI_SECS;
+    select_disk(hd);
+    outb(reg_sect_cnt(channel), multi);
+    expect_intr(channel);
+    cmd_out(channel, CMD_SET_MULTI);
+    if (wait_intr(channel, ticks + ms_to_ticks(IDE_TIMEOUT_MS)) && !(channel->status & BIT_STAT_ERR)) {
+        hd->multi_secs = multi;
+    }
+}
+
 /** 获得硬盘参数信息 */
 static void identify_disk(struct disk* hd) {
     char id_info[512];
     select_disk(hd);
+    expect_intr(hd->my_channel);
     cmd_out(hd->my_channel, CMD_IDENTIFY);
-    sema_p(&hd->my_channel->disk_done);
     
-    if (!busy_wait(hd)) {     //  若失败
+    if (!wait_intr(hd->my_channel, ticks + ms_to_ticks(IDE_TIMEOUT_MS)) ||
+        (hd->my_channel->status & (BIT_STAT_DRQ | BIT_STAT_ERR)) != BIT_STAT_DRQ) {     //  若失败
         char error[64];
         sprintf(error, "%s identify failed!!!!!!\n", hd->name);
         PANIC(error);
@@ -232,15 +515,33 @@ static void identify_disk(struct disk* hd) {
     memset(buf, 0, sizeof(buf));
     swap_pairs_bytes(id_info + md_start, buf, md_len);
     printk("       MODULE: %s\n", buf);
-    uint32_t sectors = *(uint32_t*)(id_info + 60*2);
-    printk("       SECTORS: %d\n", sectors);
-    printk("       CAPACITY: %dMB\n", sectors * 512 / 1024 / 1024);
+    uint16_t* id_words = (uint16_t*)id_info;
+    // 第 83 字的第 10 位表示支持 LBA48，此时总扇区数在 100~103 字，否则在 60~61 字
+    hd->lba48 = id_words[83] & (1 << 10);
+    hd->sectors = *(uint32_t*)(id_words + 60);
+    if (hd->lba48) {
+        // lba 只用 32 位，更大的部分访问不到
+        hd->sectors = (id_words[102] | id_words[103]) ? 0xffffffff : *(uint32_t*)(id_words + 100);
+    }
+    hd->max_secs = hd->lba48 ? IDE_MAX_SECS_LBA48 : IDE_MAX_SECS;
+    printk("       SECTORS: %d\n", hd->sectors);
+    printk("       LBA48: %s\n", hd->lba48 ? "yes" : "no");
+    // 第 49 字的第 8 位表示支持 DMA
+    hd->dma = hd->my_channel->bm_base != 0 && (id_words[49] & (1 << 8));
+    printk("       DMA: %s\n", hd->dma ? "yes" : "no");
+    // 第 48 字的第 0 位表示数据口支持 32 位 I/O(ATA-1 定义，之后的标准废弃了此字，不支持的设备为 0)
+    hd->pio32 = IDE_PIO32 && (id_words[48] & 1);
+    printk("       PIO32: %s\n", hd->pio32 ? "yes" : "no");
+    // 第 47 字低 8 位是 READ/WRITE MULTIPLE 每块最多的扇区数
+    set_multiple(hd, id_words[47] & 0xff);
+    printk("       MULTIPLE: %d\n", hd->multi_secs);
+    printk("       CAPACITY: %dMB\n", hd->sectors / 2048);
 }
 
 /** 扫描硬盘中 地址为ext_lba的扇区中 的所有分区 */
 static void partition_scan(struct disk* hd, uint32_t ext_lba) {
     struct boot_sector* bs = sys_malloc(sizeof(struct boot_sector));
-    ide_read(hd, ext_lba, bs, 1);
+    bdev_read(&hd->bdev, ext_lba, bs, 1);
     uint8_t part_idx = 0;
     struct partition_table_entry* p = bs->partition_table;
     
@@ -259,6 +560,7 @@ static void partition_scan(struct disk* hd, uint32_t ext_lba) {
                 hd->prim_parts[p_no].start_lba = ext_lba + p->start_lba;
                 hd->prim_parts[p_no].sec_cnt = p->sec_cnt;
                 hd->prim_parts[p_no].my_disk = hd;
+                hd->prim_parts[p_no].bdev = &hd->bdev;
                 list_append(&partition_list, &hd->prim_parts[p_no].part_tag);
                 sprintf(hd->prim_parts[p_no].name, "%s%d", hd->name, p_no + 1);
                 p_no++;
@@ -267,6 +569,7 @@ static void partition_scan(struct disk* hd, uint32_t ext_lba) {
                 hd->logic_parts[l_no].start_lba = ext_lba + p->start_lba;
                 hd->logic_parts[l_no].sec_cnt = p->sec_cnt;
                 hd->logic_parts[l_no].my_disk = hd;
+                hd->logic_parts[l_no].bdev = &hd->bdev;
                 list_append(&partition_list, &hd->logic_parts[l_no].part_tag);
                 sprintf(hd->logic_parts[l_no].name, "%s%d", hd->name, l_no + 5);     // 逻辑分区数字是从5开始,主分区是1～4.
                 l_no++;
@@ -295,13 +598,40 @@ void intr_hd_handler(uint8_t irq_no) {
     ASSERT(channel->irq_no == irq_no);
     // 每次读写硬盘时会申请锁，从而保证了同步一致性，此中断对应的就是这一次的 expecting_intr
     if (channel->expecting_intr) {
-        channel->expecting_intr = false;
-        sema_v(&channel->disk_done);
         // 读取状态寄存器使硬盘控制器认为此次的中断已被处理,从而硬盘可以继续执行新的读写
-        inb(reg_status(channel));
+        uint8_t status = inb(reg_status(channel));
+        if (status & BIT_STAT_BSY) {    // 多扇区写时前一扇区迟到的中断，命令还在进行
+            return;
+        }
+        channel->expecting_intr = false;
+        // DMA 传输到此结束：记下状态，停下引擎并清除中断、错误位
+        if (channel->bm_base != 0) {
+            channel->bm_status = inb(reg_bm_status(channel));
+            outb(reg_bm_cmd(channel), inb(reg_bm_cmd(channel)) & ~BM_CMD_START);
+            outb(reg_bm_status(channel), BM_STATUS_ERR | BM_STATUS_INTR);
+        }
+        channel->status = status;       // 交给等待者判断 DRQ/ERR，不必再轮询
+        wake_up(&channel->intr_wait);
     }
 }
 
+/** 在 PCI 总线上找 IDE 控制器并打开总线主控，返回主通道 DMA 寄存器的端口基址，不支持返回 0 */
+static uint16_t ide_dma_probe(void) {
+    struct pci_dev pdev;
+    if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &pdev)) {
+        return 0;
+    }
+    uint32_t bar4 = pci_read_config(&pdev, PCI_BAR0 + 4 * 4);
+    if (!(bar4 & 0x1) || (bar4 & 0xfffc) == 0) {    // 须是 I/O 空间的基址
+        return 0;
+    }
+    // 状态寄存器的位写 1 清除，只改低 16 位的命令寄存器
+    uint32_t command = pci_read_config(&pdev, PCI_COMMAND) & 0xffff;
+    pci_write_config(&pdev, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+    printk("     ide bus master at 0x%x (pci %d:%d.%d)\n", bar4 & 0xfffc, pdev.bus, pdev.dev, pdev.func);
+    return bar4 & 0xfffc;
+}
+
 /** 硬盘数据结构初始化 */
 void ide_init() {
     printk("   ide_init start...\n");
@@ -309,6 +639,7 @@ void ide_init() {
     ASSERT(hd_cnt > 0);
     channel_cnt = DIV_ROUND_UP(hd_cnt, 2);  // 一个ide通道上有两个硬盘,根据硬盘数量反推有几个ide通道
     list_init(&partition_list);
+    uint16_t bm_base = ide_dma_probe();
     struct ide_channel* channel;
     uint8_t channel_no = 0, dev_no = 0;
     
@@ -332,11 +663,20 @@ void ide_init() {
         channel->expecting_intr = false;        // 未向硬盘写入指令时不期待硬盘的中断
         mutex_init(&channel->lock);
         
-        // 初始化为0 是向硬盘控制器请求数据后 P阻塞线程
-        // 直到硬盘完成后发中断，处理程序 V唤醒线程
-        sema_init(&channel->disk_done, 0);
+        // 向硬盘控制器发出命令后驱动程序睡在这里，硬盘完成后发中断，处理程序记下状态并唤醒
+        wait_queue_init(&channel->intr_wait);
+
+        channel->bm_base = 0;
+        channel->prdt = NULL;
+        if (bm_base != 0) {
+            channel->prdt = get_pages(1, PF_KERNEL);    // 一页物理上连续，满足描述符表的对齐要求
+            if (channel->prdt != NULL) {
+                channel->bm_base = bm_base + channel_no * 8;
+            }
+        }
         
         register_handler(channel->irq_no, intr_hd_handler);
+        bio_channel_init(channel);  // 扫描分区要读硬盘，先把请求队列和派发线程准备好
 
         // 分别获取两个硬盘的参数及分区信息
         while (dev_no < 2) {
@@ -345,6 +685,7 @@ void ide_init() {
             hd->dev_no = dev_no;
             sprintf(hd->name, "sd%c", 'a' + channel_no * 2 + dev_no);
             identify_disk(hd);     // 获取硬盘参数
+            bdev_register(&hd->bdev, hd->name, &ide_ops);
             if (dev_no != 0) {     // 内核本身的裸硬盘(hd60M.img)不处理
                 partition_scan(hd, 0);  // 扫描该硬盘上的分区
             }
@@ -4,6 +4,9 @@
 #include "sync.h"
 #include "bitmap.h"
 #include "super_block.h"
+#include "workqueue.h"
+#include "blkdev.h"
+#include "iostat.h"
 
 /* 分区结构 */
 struct partition {
@@ -13,6 +16,7 @@ struct partition {
     uint32_t sec_cnt;           // 扇区数
 
     struct disk* my_disk;       // 分区所属的硬盘
+    struct block_device* bdev;  // 分区所在的块设备，文件系统通过它读写
 
     struct list_elem part_tag;  // 用于队列中的标记
    
@@ -20,14 +24,32 @@ struct partition {
     struct bitmap block_bitmap; // 块位图
     struct bitmap inode_bitmap; // inode 位图
     struct list open_inodes;    // 本分区打开的 inode 队列
+    struct rw_semaphore inode_lock; // 保护 open_inodes：查找用读锁，增删用写锁
+    struct rw_semaphore dir_lock;   // 路径查找用读锁，创建文件等修改目录项时用写锁
+
+    struct delayed_work writeback;  // 推迟回写被修改的位图扇区和元数据缓存
+    struct bitmap dirty_btmp_secs;  // 待回写的位图扇区，块位图在前 inode 位图在后
+    struct bcache* bcache;          // inode 表、目录块等元数据扇区的缓存
+    struct io_stats stats;          // 落在本分区上的读写统计
 };
 
 /* 硬盘结构 */
 struct disk {
     char name[8];                   // 本硬盘的名称，如sda等
+    struct block_device bdev;       // 硬盘对外的块设备
 
     struct ide_channel* my_channel; // 此块硬盘归属于哪个ide通道
     uint8_t dev_no;                 // 本硬盘是主0还是从1
+    bool dma;                       // 硬盘和控制器都支持总线主控 DMA
+    bool pio32;                     // PIO 按双字读写数据口，否则按字
+    bool lba48;                     // 支持 48 位 LBA 命令
+    uint8_t multi_secs;             // READ/WRITE MULTIPLE 每块的扇区数，1 表示不用
+    uint32_t sectors;               // 总扇区数
+    uint32_t max_secs;              // 一条命令最多读写的扇区数，请求合并不超过它
+    struct list bio_queue;          // 待下发的请求，按起始扇区排序
+    uint32_t head_lba;              // 上一条命令结束的扇区，电梯从这里继续
+    uint32_t nr_inflight;           // 已提交还未完成的请求数
+    struct io_stats stats;          // 本硬盘的读写统计
     
     struct partition prim_parts[4]; // 主分区最多4个
     struct partition logic_parts[8];// 逻辑分区理论数量不限，但写到代码里总得有上限，设8个
@@ -41,7 +63,12 @@ struct ide_channel {
     // 无法区分中断来源硬盘，所以一次只允许通道中1个硬盘操作
     struct mutex_t lock;        // 通道锁
     bool expecting_intr;        // 表示等待硬盘的中断
-    struct semaphore disk_done; // 用于阻塞、唤醒驱动程序
+    struct wait_queue intr_wait;// 驱动程序在此等待硬盘中断
+    uint16_t bm_base;           // 总线主控 DMA 寄存器的端口基址，0 表示不支持 DMA
+    struct prd* prdt;           // DMA 用的物理区域描述符表，占一页
+    uint8_t status;             // 中断处理程序读到的状态寄存器
+    uint8_t bm_status;          // 中断处理程序读到的 DMA 状态寄存器
+    struct wait_queue bio_pending;  // 派发线程在此等待新请求
     struct disk devices[2];     // 一个通道上连接两个硬盘，一主一从
 };
 
@@ -49,8 +76,11 @@ extern uint8_t channel_cnt;
 extern struct ide_channel channels[];
 
 void ide_init (void);
-void ide_read (struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
-void ide_write(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
+#define bdev_to_disk(b) (elem2entry(struct disk, bdev, b))
+
+
+struct partition* disk_part_of(struct disk* hd, uint32_t lba);
+int32_t ide_transfer(struct disk* hd, struct list* batch, uint32_t lba, uint32_t sec_cnt, bool write);
 
 void intr_hd_handler(uint8_t irq_no); 
 
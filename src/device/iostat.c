@@ -0,0 +1,98 @@
+#include "iostat.h"
+#include "ide.h"
+#include "bio.h"
+#include "timer.h"
+#include "stdio-kernel.h"
+
+/** 周期数所在的直方图格子 */
+static uint32_t iostat_bucket(uint64_t cycles) {
+    uint32_t high = cycles >> 32, low = cycles;
+    if (high != 0) {
+        return IOSTAT_HIST_BUCKETS - 1;
+    }
+    if (low == 0) {
+        return 0;
+    }
+    uint32_t log2;
+    asm ("bsr %1, %0" : "=r" (log2) : "rm" (low));
+    if (log2 < IOSTAT_HIST_SHIFT) {
+        return 0;
+    }
+    log2 -= IOSTAT_HIST_SHIFT;
+    return log2 < IOSTAT_HIST_BUCKETS ? log2 : IOSTAT_HIST_BUCKETS - 1;
+}
+
+/** 请求入队时调用，depth 为包括它在内的在途请求数 */
+void iostat_submit(struct io_stats* stats, uint32_t depth) {
+    stats->depth_sum += depth;
+    if (depth > stats->depth_max) {
+        stats->depth_max = depth;
+    }
+}
+
+/** 一条命令完成时调用，记下等锁和服务的周期数 */
+void iostat_cmd_done(struct io_stats* stats, uint64_t lock_wait, uint64_t service) {
+    stats->cmds++;
+    stats->lock_wait_tsc += lock_wait;
+    stats->service_tsc += service;
+    stats->service_hist[iostat_bucket(service)]++;
+}
+
+/** 请求完成、调用 bio_endio 之前调用，status 为请求的结果，now 为完成时刻的 tsc */
+void iostat_bio_done(struct io_stats* stats, struct bio* bio, int32_t status, uint64_t now) {
+    uint64_t await = now - bio->submit_tsc;
+    stats->ops[bio->write]++;
+    stats->secs[bio->write] += bio->sec_cnt;
+    if (status != 0) {
+        stats->errors++;
+    }
+    stats->await_tsc += await;
+    stats->await_hist[iostat_bucket(await)]++;
+}
+
+/** 打印直方图中非零的格子 */
+static void iostat_print_hist(const char* title, uint32_t* hist) {
+    printk("  %s LOG2_CYCLES:COUNT", title);
+    for (uint32_t i = 0; i < IOSTAT_HIST_BUCKETS; i++) {
+        if (hist[i] != 0) {
+            printk(" %d:%u", i + IOSTAT_HIST_SHIFT, hist[i]);
+        }
+    }
+    printk("\n");
+}
+
+/** 打印一组统计，时间换算成微秒。没有读写过的不打印 */
+void iostat_print(const char* name, struct io_stats* stats) {
+    uint32_t ops = stats->ops[0] + stats->ops[1];
+    if (ops == 0 && stats->cmds == 0) {
+        return;
+    }
+    uint32_t cmds = stats->cmds != 0 ? stats->cmds : 1;
+    uint32_t nr = ops != 0 ? ops : 1;
+    printk("%s R %u/%u W %u/%u ERR %u CMDS %u DEPTH avg %u max %u\n",
+        name, stats->ops[0], stats->secs[0], stats->ops[1], stats->secs[1], stats->errors,
+        stats->cmds, stats->depth_sum / nr, stats->depth_max);
+    printk("  LOCK_WAIT %uus SERVICE %uus (avg %uus) AWAIT %uus (avg %uus)\n",
+        tsc_to_us(stats->lock_wait_tsc), tsc_to_us(stats->service_tsc), tsc_to_us(stats->service_tsc) / cmds,
+        tsc_to_us(stats->await_tsc), tsc_to_us(stats->await_tsc) / nr);
+    iostat_print_hist("SERVICE", stats->service_hist);
+    iostat_print_hist("AWAIT", stats->await_hist);
+}
+
+/** 打印各硬盘及其分区的读写统计。
+ * 分区的 AWAIT 远大于硬盘的 SERVICE 时时间花在排队上，两者接近时瓶颈在硬盘本身 */
+void sys_disk_stats(void) {
+    printk("NAME R OPS/SECS W OPS/SECS ...\n");
+    for (uint8_t channel_no = 0; channel_no < channel_cnt; channel_no++) {
+        for (uint8_t dev_no = 0; dev_no < 2; dev_no++) {
+            struct disk* hd = &channels[channel_no].devices[dev_no];
+            iostat_print(hd->name, &hd->stats);
+            for (uint8_t i = 0; i < 4; i++) {
+                iostat_print(hd->prim_parts[i].name, &hd->prim_parts[i].stats);
+            }
+            for (uint8_t i = 0; i < 8; i++) {
+                iostat_print(hd->logic_parts[i].name, &hd->logic_parts[i].stats);
+            }
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef __DEVICE_IOSTAT_H
+#define __DEVICE_IOSTAT_H
+#include "stdint.h"
+#include "global.h"
+
+#define IOSTAT_HIST_BUCKETS 16  // 延迟直方图：第 i 格为 [2^(i+12), 2^(i+13)) 个周期，两端的格子兼收越界值
+#define IOSTAT_HIST_SHIFT   12
+
+struct bio;
+
+/* 硬盘或分区的读写统计。请求的延迟从提交算到完成，包含排队；
+ * 服务时间从拿到通道锁算到命令完成，只是硬盘本身的时间。
+ * 只由所在通道的派发线程和关中断的提交路径修改 */
+struct io_stats {
+    uint32_t ops[2];            // 完成的请求数，下标 0 读 1 写
+    uint32_t secs[2];           // 读写的扇区数
+    uint32_t errors;            // 失败的请求数
+    uint32_t cmds;              // 下发的命令数，相邻请求合并后一条命令可完成多个请求
+    uint32_t depth_sum;         // 每次提交时已在途的请求数之和，除以请求数即平均队列深度
+    uint32_t depth_max;
+    uint64_t lock_wait_tsc;     // 等通道锁的周期数，同一通道的另一块硬盘占着通道时才会等
+    uint64_t service_tsc;       // 命令的服务时间
+    uint64_t await_tsc;         // 请求从提交到完成的时间
+    uint32_t service_hist[IOSTAT_HIST_BUCKETS];
+    uint32_t await_hist[IOSTAT_HIST_BUCKETS];
+};
+
+void iostat_submit(struct io_stats* stats, uint32_t depth);
+void iostat_cmd_done(struct io_stats* stats, uint64_t lock_wait, uint64_t service);
+void iostat_bio_done(struct io_stats* stats, struct bio* bio, int32_t status, uint64_t now);
+void iostat_print(const char* name, struct io_stats* stats);
+void sys_disk_stats(void);
+
+#endif
@@ -3,8 +3,10 @@
 #include "interrupt.h"
 #include "io.h"
 #include "global.h"
+#include "workqueue.h"
 
 #define KBD_BUF_PORT    0x60         // 键盘buffer寄存器端口号为0x60
+#define SCANCODE_BUF_SIZE 64         // 中断处理程序暂存扫描码的环形缓冲区大小，须为 2 的幂
 
 /* 用转义字符定义部分控制字符 */
 #define esc             '\033'        // 八进制表示,十六进制 '\x1b'
@@ -36,6 +38,11 @@
 
 struct ioqueue kbd_buf; // 键盘缓冲区
 
+/* 中断处理程序只把扫描码放进这里，翻译成字符推迟到 kbd_work 中做 */
+static uint8_t scancode_buf[SCANCODE_BUF_SIZE];
+static uint32_t scancode_head, scancode_tail;
+static struct work_struct kbd_work;
+
 // 记录makecode是否以0xe0开头
 static bool ext_scancode;
 
@@ -110,14 +117,14 @@ static char keymap[][2] = {
     /*其它按键暂不处理*/
 };
 
-/* 键盘中断处理程序 */
-static void intr_keyboard_handler(void) { 
+/* 把一个扫描码翻译成字符放入 kbd_buf，或更新控制键状态。需在关中断下调用 */
+static void kbd_translate(uint8_t raw_scancode) { 
     
     /* 这次中断发生前的上一次中断,以下任意三个键是否有按下 */
 
     bool shift_down_last = shift_status;
      
-    uint16_t scancode = inb(KBD_BUF_PORT);
+    uint16_t scancode = raw_scancode;
     
     // 若扫描码 e0 开头,等待下一个扫描码拼接  
     if (scancode == 0xe0) {
@@ -202,10 +209,32 @@ static void intr_keyboard_handler(void) {
     }
 }
 
+/** kbd_work 的处理函数：翻译中断处理程序积攒下的扫描码 */
+static void kbd_process(__attribute__((unused)) void* arg) {
+    enum intr_status old_status = intr_disable();
+    while (scancode_tail != scancode_head) {
+        kbd_translate(scancode_buf[scancode_tail++ & (SCANCODE_BUF_SIZE - 1)]);
+        // 每处理一个扫描码开一下中断，别让时钟等中断等太久
+        intr_set_status(old_status);
+        intr_disable();
+    }
+    intr_set_status(old_status);
+}
+
+/* 键盘中断处理程序：必须读走扫描码，键盘才会继续产生中断，其余的交给 kworker */
+static void intr_keyboard_handler(void) {
+    uint8_t scancode = inb(KBD_BUF_PORT);
+    if (scancode_head - scancode_tail < SCANCODE_BUF_SIZE) {    // 满了就丢掉
+        scancode_buf[scancode_head++ & (SCANCODE_BUF_SIZE - 1)] = scancode;
+    }
+    queue_work(&kbd_work);
+}
+
 /* 键盘初始化 */
 void keyboard_init() {
     put_str("   keyboard init start...\n");
     ioqueue_init(&kbd_buf);
+    work_init(&kbd_work, kbd_process, NULL);
     register_handler(0x21, intr_keyboard_handler);
     put_str("   keyboard init done!\n");
 }
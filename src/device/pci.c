@@ -0,0 +1,53 @@
+#include "pci.h"
+#include "io.h"
+
+#define PCI_CONFIG_ADDRESS  0xcf8   // 配置空间地址端口，写入要访问的 总线/设备/功能/寄存器
+#define PCI_CONFIG_DATA     0xcfc   // 配置空间数据端口
+
+/** 配置空间地址：第 31 位使能，总线 8 位、设备 5 位、功能 3 位，寄存器按 4 字节对齐 */
+static uint32_t pci_config_addr(struct pci_dev* pdev, uint8_t offset) {
+    return 0x80000000 | (pdev->bus << 16) | (pdev->dev << 11) | (pdev->func << 8) | (offset & 0xfc);
+}
+
+/** 读配置空间中 offset 处的 4 字节 */
+uint32_t pci_read_config(struct pci_dev* pdev, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_config_addr(pdev, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+/** 写配置空间中 offset 处的 4 字节 */
+void pci_write_config(struct pci_dev* pdev, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_config_addr(pdev, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+/** 遍历所有总线找第一个类别为 class_code/subclass 的功能，找到返回 true */
+bool pci_find_class(uint8_t class_code, uint8_t subclass, struct pci_dev* found) {
+    struct pci_dev pdev;
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint32_t dev = 0; dev < 32; dev++) {
+            pdev.bus = bus;
+            pdev.dev = dev;
+            for (uint32_t func = 0; func < 8; func++) {
+                pdev.func = func;
+                uint32_t id = pci_read_config(&pdev, PCI_VENDOR_ID);
+                if ((id & 0xffff) == 0xffff) {      // 没有这个设备/功能
+                    if (func == 0) {
+                        break;
+                    }
+                    continue;
+                }
+                uint32_t class_rev = pci_read_config(&pdev, PCI_CLASS_REVISION);
+                if ((class_rev >> 24) == class_code && ((class_rev >> 16) & 0xff) == subclass) {
+                    *found = pdev;
+                    return true;
+                }
+                // 头类型第 7 位为 0 表示单功能设备，不用再看其余功能
+                if (func == 0 && !(pci_read_config(&pdev, PCI_HEADER_TYPE) & 0x800000)) {
+                    break;
+                }
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,30 @@
+#ifndef __DEVICE_PCI_H
+#define __DEVICE_PCI_H
+#include "stdint.h"
+#include "global.h"
+
+/* 配置空间中的寄存器偏移 */
+#define PCI_VENDOR_ID       0x00
+#define PCI_COMMAND         0x04    // 低 16 位命令寄存器，高 16 位状态寄存器
+#define PCI_CLASS_REVISION  0x08    // 类别码在高 16 位
+#define PCI_HEADER_TYPE     0x0c    // 头类型在 16~23 位
+#define PCI_BAR0            0x10    // 6 个基址寄存器，每个 4 字节
+
+#define PCI_COMMAND_IO      0x1     // 响应 I/O 空间访问
+#define PCI_COMMAND_MASTER  0x4     // 允许作为总线主控发起 DMA
+
+#define PCI_CLASS_STORAGE   0x01    // 大容量存储控制器
+#define PCI_SUBCLASS_IDE    0x01
+
+/* 一个 PCI 功能的地址 */
+struct pci_dev {
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t func;
+};
+
+uint32_t pci_read_config(struct pci_dev* pdev, uint8_t offset);
+void pci_write_config(struct pci_dev* pdev, uint8_t offset, uint32_t value);
+bool pci_find_class(uint8_t class_code, uint8_t subclass, struct pci_dev* found);
+
+#endif
@@ -0,0 +1,152 @@
+#include "raid.h"
+#include "ide.h"
+#include "bio.h"
+#include "stdio-kernel.h"
+#include "debug.h"
+
+#define RAID_BATCH      8       // 一次提交的 bio 数，各成员盘的队列里同时都有请求
+#define RAID_MAX_DEVS   1
+
+uint8_t raid_cnt;
+struct raid_dev raid_devs[RAID_MAX_DEVS];
+
+/** 把阵列中的条带号 chunk 映射到成员盘，返回成员下标，*member_chunk 为成员盘上的条带号 */
+static uint8_t raid_map(struct raid_dev* raid, uint32_t chunk, uint32_t* member_chunk) {
+    if (raid->level == RAID0) {
+        *member_chunk = chunk / raid->nr_members;
+        return chunk % raid->nr_members;
+    }
+    // 镜像的读也按条带轮流分给各盘，大块读和并发的读都能让所有盘同时工作
+    *member_chunk = chunk;
+    return chunk % raid->nr_members;
+}
+
+/** 读写阵列上 [lba, lba+sec_cnt) 的扇区：按条带拆成 bio 成批提交到各成员盘，再一起等待。
+ * 镜像写每个条带要写所有成员盘。成功返回 0，任一部分失败返回 -1 */
+static int32_t raid_rw(struct raid_dev* raid, uint32_t lba, void* buf, uint32_t sec_cnt, bool write) {
+    struct bio bios[RAID_BATCH];
+    uint32_t nr = 0;
+    int32_t ret = 0;
+    uint32_t secs_done = 0;
+    while (secs_done < sec_cnt) {
+        uint32_t cur = lba + secs_done;
+        uint32_t off = cur % raid->chunk_secs;
+        uint32_t secs_op = raid->chunk_secs - off;
+        if (secs_op > sec_cnt - secs_done) {
+            secs_op = sec_cnt - secs_done;
+        }
+        uint32_t member_chunk;
+        uint8_t member = raid_map(raid, cur / raid->chunk_secs, &member_chunk);
+        uint32_t member_lba = member_chunk * raid->chunk_secs + off;
+        void* piece = (uint8_t*)buf + secs_done * 512;
+
+        uint8_t copies = (raid->level == RAID1 && write) ? raid->nr_members : 1;
+        for (uint8_t i = 0; i < copies; i++) {
+            struct block_device* bdev = raid->members[copies == 1 ? member : i];
+            bio_init(&bios[nr], bdev, member_lba, piece, secs_op, write);
+            bio_submit(&bios[nr]);
+            if (++nr == RAID_BATCH) {
+                while (nr > 0) {
+                    if (bio_wait(&bios[--nr]) != 0) {
+                        ret = -1;
+                    }
+                }
+            }
+        }
+        secs_done += secs_op;
+    }
+    while (nr > 0) {
+        if (bio_wait(&bios[--nr]) != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static int32_t raid_read(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+    return raid_rw(elem2entry(struct raid_dev, bdev, bdev), lba, buf, sec_cnt, false);
+}
+
+static int32_t raid_write(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+    return raid_rw(elem2entry(struct raid_dev, bdev, bdev), lba, buf, sec_cnt, true);
+}
+
+/** 依次冲刷各成员盘 */
+static int32_t raid_flush(struct block_device* bdev) {
+    struct raid_dev* raid = elem2entry(struct raid_dev, bdev, bdev);
+    int32_t ret = 0;
+    for (uint8_t i = 0; i < raid->nr_members; i++) {
+        if (bdev_flush(raid->members[i]) != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static uint32_t raid_capacity(struct block_device* bdev) {
+    struct raid_dev* raid = elem2entry(struct raid_dev, bdev, bdev);
+    return raid->sectors;
+}
+
+static const struct block_ops raid_ops = {
+    .read = raid_read,
+    .write = raid_write,
+    .flush = raid_flush,
+    .capacity = raid_capacity,
+    .submit = NULL
+};
+
+/** 用 members 中的 nr 个块设备组成阵列 */
+static void raid_assemble(struct raid_dev* raid, const char* name, enum raid_level level,
+                          struct block_device** members, uint8_t nr) {
+    ASSERT(nr > 0 && nr <= RAID_MAX_MEMBERS);
+    raid->level = level;
+    raid->nr_members = nr;
+    raid->chunk_secs = RAID_CHUNK_SECS;
+    uint32_t min_secs = bdev_capacity(members[0]);
+    for (uint8_t i = 0; i < nr; i++) {
+        raid->members[i] = members[i];
+        if (bdev_capacity(members[i]) < min_secs) {
+            min_secs = bdev_capacity(members[i]);
+        }
+    }
+    // 成员盘按最小的算，条带只用完整的
+    min_secs -= min_secs % raid->chunk_secs;
+    raid->sectors = level == RAID0 ? min_secs * nr : min_secs;
+    bdev_register(&raid->bdev, name, &raid_ops);
+    printk("     %s: raid%d, %s + %s, %dMB\n", raid->bdev.name, level == RAID0 ? 0 : 1,
+        members[0]->name, nr > 1 ? members[1]->name : "-", raid->sectors / 2048);
+}
+
+/** hd 能否当成员盘：不是内核所在的 sda，且 partition_scan 没在上面找到分区。
+ * 有分区的盘上可能有已挂载的文件系统，条带会把它和分区表一起写坏 */
+static bool raid_member_ok(struct disk* hd) {
+    return hd != &channels[0].devices[0] && hd->sectors > 0 &&
+           hd->prim_parts[0].my_disk == NULL && hd->logic_parts[0].my_disk == NULL;
+}
+
+/** 有两个通道、每个通道上都有空闲盘时，用各通道上第一块空闲盘组成 md0。
+ * 组装只登记成员不写盘，成员盘上原有的数据在有人写 md0 之前不受影响 */
+void raid_init(void) {
+    printk("   raid_init start...\n");
+    raid_cnt = 0;
+    if (channel_cnt == 2) {
+        struct block_device* members[RAID_MAX_MEMBERS];
+        uint8_t nr = 0;
+        for (uint8_t channel_no = 0; channel_no < 2; channel_no++) {
+            for (uint8_t dev_no = 0; dev_no < 2; dev_no++) {
+                struct disk* hd = &channels[channel_no].devices[dev_no];
+                if (raid_member_ok(hd)) {
+                    members[nr++] = &hd->bdev;
+                    break;
+                }
+            }
+        }
+        if (nr == RAID_MAX_MEMBERS) {
+            raid_assemble(&raid_devs[raid_cnt++], "md0", RAID0, members, nr);
+        } else {
+            printk("     no disk without partitions on both channels, md0 not assembled\n");
+        }
+    }
+    printk("   raid_init done!\n");
+}
@@ -0,0 +1,30 @@
+#ifndef __DEVICE_RAID_H
+#define __DEVICE_RAID_H
+#include "stdint.h"
+#include "global.h"
+#include "blkdev.h"
+
+#define RAID_MAX_MEMBERS    2
+#define RAID_CHUNK_SECS     128     // 条带大小，64KB
+
+enum raid_level {
+    RAID0,      // 条带：相邻的条带轮流放在各成员盘上，容量相加
+    RAID1       // 镜像：每个成员盘都是完整的一份，读分摊到各盘
+};
+
+/* 由不同通道上的硬盘组成的块设备。各通道有自己的中断和派发线程，成员盘可以同时工作 */
+struct raid_dev {
+    struct block_device bdev;
+    enum raid_level level;
+    uint8_t nr_members;
+    struct block_device* members[RAID_MAX_MEMBERS];
+    uint32_t chunk_secs;
+    uint32_t sectors;       // 对外的总扇区数
+};
+
+extern uint8_t raid_cnt;
+extern struct raid_dev raid_devs[];
+
+void raid_init(void);
+
+#endif
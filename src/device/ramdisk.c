@@ -0,0 +1,66 @@
+#include "ramdisk.h"
+#include "memory.h"
+#include "string.h"
+#include "stdio-kernel.h"
+#include "global.h"
+
+static struct ramdisk ram0;
+
+static int32_t ramdisk_read(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+    struct ramdisk* rd = elem2entry(struct ramdisk, bdev, bdev);
+    memcpy(buf, rd->data + lba * 512, sec_cnt * 512);
+    return 0;
+}
+
+static int32_t ramdisk_write(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+    struct ramdisk* rd = elem2entry(struct ramdisk, bdev, bdev);
+    memcpy(rd->data + lba * 512, buf, sec_cnt * 512);
+    return 0;
+}
+
+static uint32_t ramdisk_capacity(struct block_device* bdev) {
+    struct ramdisk* rd = elem2entry(struct ramdisk, bdev, bdev);
+    return rd->sectors;
+}
+
+// 读写在调用者中同步完成，没有缓存可冲刷
+static const struct block_ops ramdisk_ops = {
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+    .flush = NULL,
+    .capacity = ramdisk_capacity,
+    .submit = NULL
+};
+
+/** 在 rd 上建一个 sectors 个扇区的内存盘并登记为 name，内容清零。内存不足返回 false */
+static bool ramdisk_setup(struct ramdisk* rd, const char* name, uint32_t sectors) {
+    rd->data = get_pages(DIV_ROUND_UP(sectors * 512, PG_SIZE), PF_KERNEL);
+    if (rd->data == NULL) {
+        return false;
+    }
+    rd->sectors = sectors;
+    bdev_register(&rd->bdev, name, &ramdisk_ops);
+    return true;
+}
+
+/** 动态创建内存盘，失败返回 NULL */
+struct block_device* ramdisk_create(const char* name, uint32_t sectors) {
+    struct ramdisk* rd = kmalloc(sizeof(struct ramdisk));
+    if (rd == NULL) {
+        return NULL;
+    }
+    if (!ramdisk_setup(rd, name, sectors)) {
+        kfree(rd);
+        return NULL;
+    }
+    return &rd->bdev;
+}
+
+/** 建立默认的内存盘 ram0 */
+void ramdisk_init(void) {
+    printk("   ramdisk_init start...\n");
+    if (ramdisk_setup(&ram0, "ram0", RAMDISK_SECS)) {
+        printk("     ram0: %dKB\n", RAMDISK_SECS / 2);
+    }
+    printk("   ramdisk_init done!\n");
+}
@@ -0,0 +1,18 @@
+#ifndef __DEVICE_RAMDISK_H
+#define __DEVICE_RAMDISK_H
+#include "stdint.h"
+#include "blkdev.h"
+
+#define RAMDISK_SECS    2048    // ram0 的扇区数，1MB
+
+/* 内存盘：用一段内核内存当硬盘，读写就是复制，没有真实硬件也能跑文件系统 */
+struct ramdisk {
+    struct block_device bdev;
+    uint8_t* data;
+    uint32_t sectors;
+};
+
+struct block_device* ramdisk_create(const char* name, uint32_t sectors);
+void ramdisk_init(void);
+
+#endif
@@ -6,6 +6,8 @@
 #include "debug.h"
 #include "global.h"
 #include "math.h"
+#include "cpu.h"
+#include "workqueue.h"
 
 #define IRQ0_FREQUENCY      100
 #define INPUT_FREQUENCY     1193180
@@ -17,10 +19,16 @@
 #define PIT_CONTROL_PORT    0x43
 
 #define millsec_per_intr    (1000 / IRQ0_FREQUENCY)
+#define TSC_CALIBRATE_TICKS 10  // 用多少个嘀嗒校准 tsc 频率
 #define seconds_per_intr    (1.0 / IRQ0_FREQUENCY)
 
 uint32_t ticks;          // ticks是内核自中断开启以来总共的嘀嗒数
 
+static struct list timeout_list;    // 设置了超时的阻塞线程，按超时时刻升序排列
+
+uint32_t tsc_per_ms;
+static uint64_t calibrate_tsc;      // 校准开始时的 tsc
+
 
 /* 把操作的计数器counter_no、读写锁属性rwl、计数器模式counter_mode写入模式控制寄存器,
  赋予初始值counter_value */
@@ -37,6 +45,52 @@ static void frequency_set(uint8_t counter_port, \
     outb(counter_port, (uint8_t)counter_value >> 8);
 }
 
+/** 超时时刻 a 是否早于 b，ticks 回绕时也成立 */
+static bool tick_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+/** timeout_ticks 后若 pthread 仍阻塞则把它唤醒，需在关中断下调用 */
+void timer_arm(struct task_struct* pthread, uint32_t timeout_ticks) {
+    ASSERT(intr_get_status() == INTR_OFF);
+    pthread->wakeup_tick = ticks + timeout_ticks;
+    pthread->timed_out = false;
+    struct list_elem* elem = timeout_list.head.next;
+    while (elem != &timeout_list.tail) {
+        struct task_struct* other = elem2entry(struct task_struct, timer_tag, elem);
+        if (tick_before(pthread->wakeup_tick, other->wakeup_tick)) {
+            break;
+        }
+        elem = elem->next;
+    }
+    list_insert_before(elem, &pthread->timer_tag);
+}
+
+/** 撤掉 pthread 的超时，没有设置过则什么也不做 */
+void timer_disarm(struct task_struct* pthread) {
+    enum intr_status old_status = intr_disable();
+    if (elem_find(&timeout_list, &pthread->timer_tag)) {
+        list_remove(&pthread->timer_tag);
+    }
+    intr_set_status(old_status);
+}
+
+/** 唤醒所有已到期的线程，它们若还挂在某个等待队列上要先摘下来 */
+static void timer_expire(void) {
+    while (!list_empty(&timeout_list)) {
+        struct task_struct* pthread = elem2entry(struct task_struct, timer_tag, timeout_list.head.next);
+        if (tick_before(ticks, pthread->wakeup_tick)) {
+            break;
+        }
+        list_remove(&pthread->timer_tag);
+        if (pthread->wait_list != NULL) {
+            list_remove(&pthread->general_tag);
+        }
+        pthread->timed_out = true;
+        thread_unblock(pthread);
+    }
+}
+
 /* 时钟的中断处理函数 */
 static void intr_timer_handler(void) {
     struct task_struct* cur_thread = running_thread();
@@ -45,6 +99,14 @@ static void intr_timer_handler(void) {
     
     cur_thread->elapsed_ticks++;    // 记录此线程占用的cpu时间
     ticks++;   //从内核第一次处理时间中断后开始至今的滴哒数,内核态和用户态总共的嘀哒数
+    if (ticks == 1) {               // 以 PIT 为基准校准 tsc
+        calibrate_tsc = rdtsc();
+    } else if (ticks == 1 + TSC_CALIBRATE_TICKS) {
+        tsc_per_ms = (uint32_t)(rdtsc() - calibrate_tsc) / (TSC_CALIBRATE_TICKS * millsec_per_intr);
+    }
+    sched_tick();                   // 统计 cpu 利用率，定期做负载均衡
+    timer_expire();                 // 唤醒超时的线程
+    workqueue_tick();               // 到期的延迟工作入队
     
     if (cur_thread->ticks == 0) {   // 若进程时间片用完就开始调度新的进程上cpu
         schedule();
@@ -54,19 +116,40 @@ static void intr_timer_handler(void) {
     
 }
 
+/** 毫秒换算成嘀嗒数，向上取整 */
+uint32_t ms_to_ticks(uint32_t m_seconds) {
+    return DIV_ROUND_UP(m_seconds, millsec_per_intr);
+}
+
+/** tsc 周期数换算成微秒，未校准时返回 0。没有 libgcc，64 位除法用 divl 完成 */
+uint32_t tsc_to_us(uint64_t tsc) {
+    uint32_t per_us = tsc_per_ms / 1000;
+    if (per_us == 0) {
+        return 0;
+    }
+    uint32_t high = tsc >> 32, low = tsc, us, rem;
+    if (high >= per_us) {           // 商超过 32 位
+        return 0xffffffff;
+    }
+    asm ("divl %4" : "=a" (us), "=d" (rem) : "a" (low), "d" (high), "rm" (per_us));
+    return us;
+}
+
 /* 以tick为单位的sleep,任何时间形式的sleep会转换此ticks形式 */
 static void ticks_to_sleep(uint32_t sleep_ticks) {
-    uint32_t start_tick = ticks;
-    // 若间隔的 ticks 数不够，就让出自己
-    while (ticks - start_tick < sleep_ticks) {
-        thread_yield();
+    if (sleep_ticks == 0) {
+        return;
     }
+    // 阻塞到时钟中断把自己唤醒，期间不再占用 cpu 反复让出
+    enum intr_status old_status = intr_disable();
+    timer_arm(running_thread(), sleep_ticks);
+    thread_block(TASK_BLOCKED);
+    intr_set_status(old_status);
 }
 
 /* 以毫秒为单位的sleep   1秒= 1000毫秒 */
 void msleep(uint32_t m_seconds) {
-    uint32_t sleep_ticks = DIV_ROUND_UP(m_seconds, millsec_per_intr);
-    ticks_to_sleep(sleep_ticks);
+    ticks_to_sleep(ms_to_ticks(m_seconds));
 }
 
 void sleep(uint32_t seconds) {
@@ -79,6 +162,7 @@ void timer_init() {
     put_str("   timer_init start...\n");
     /* 设置8253的定时周期,也就是发中断的周期 */
     frequency_set(CONTRER0_PORT, COUNTER0_NO, READ_WRITE_LATCH, COUNTER_MODE, COUNTER0_VALUE);
+    list_init(&timeout_list);
     register_handler(0x20, intr_timer_handler);
     
     put_str("   timer_init done!\n");
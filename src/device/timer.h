@@ -2,8 +2,18 @@
 #define __DEVICE_TIME_H
 #include "stdint.h"
 
+extern uint32_t ticks;
+extern uint32_t tsc_per_ms;     // 每毫秒的 tsc 周期数，开机后前几个嘀嗒校准，之前为 0
+
+struct task_struct;
+
 void timer_init(void);
 
+uint32_t ms_to_ticks(uint32_t m_seconds);
+uint32_t tsc_to_us(uint64_t tsc);
+void timer_arm(struct task_struct* pthread, uint32_t timeout_ticks);
+void timer_disarm(struct task_struct* pthread);
+
 void sleep(uint32_t seconds);
 void msleep(uint32_t m_seconds);
 
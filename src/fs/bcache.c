@@ -0,0 +1,210 @@
+#include "bcache.h"
+#include "ide.h"
+#include "memory.h"
+#include "string.h"
+#include "timer.h"
+#include "debug.h"
+#include "stdio-kernel.h"
+
+/** 为分区建立元数据缓存，内存不足返回 false */
+bool bcache_init(struct partition* part) {
+    struct bcache* cache = get_pages(DIV_ROUND_UP(sizeof(struct bcache), PG_SIZE), PF_KERNEL);
+    if (cache == NULL) {
+        return false;
+    }
+    mutex_init(&cache->lock);
+    list_init(&cache->lru);
+    cache->nr_dirty = 0;
+    for (uint32_t i = 0; i < BCACHE_BUFS; i++) {
+        cache->bufs[i].lba = 0;
+        cache->bufs[i].dirty = false;
+        list_append(&cache->lru, &cache->bufs[i].lru_tag);
+    }
+    part->bcache = cache;
+    return true;
+}
+
+/** 在缓存中找 lba，找到则移到 lru 尾部。调用者持有 cache->lock */
+static struct buffer_head* bcache_lookup(struct bcache* cache, uint32_t lba) {
+    struct list_elem* elem = cache->lru.tail.prev;   // 从最近用过的找起
+    while (elem != &cache->lru.head) {
+        struct buffer_head* bh = elem2entry(struct buffer_head, lru_tag, elem);
+        if (bh->lba == lba) {
+            list_remove(&bh->lru_tag);
+            list_append(&cache->lru, &bh->lru_tag);
+            return bh;
+        }
+        elem = elem->prev;
+    }
+    return NULL;
+}
+
+/** 把所有脏扇区一起提交再一起等待，相邻的在请求队列中合并。调用者持有 cache->lock */
+static void __bcache_flush(struct partition* part, struct bcache* cache) {
+    if (cache->nr_dirty == 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < BCACHE_BUFS; i++) {
+        struct buffer_head* bh = &cache->bufs[i];
+        if (bh->dirty) {
+            bio_init(&bh->bio, part->bdev, bh->lba, bh->data, 1, true);
+            bio_submit(&bh->bio);
+        }
+    }
+    for (uint32_t i = 0; i < BCACHE_BUFS; i++) {
+        struct buffer_head* bh = &cache->bufs[i];
+        if (bh->dirty) {
+            // 写失败的留作脏的，下次再试
+            if (bio_wait(&bh->bio) == 0) {
+                bh->dirty = false;
+                cache->nr_dirty--;
+            }
+        }
+    }
+}
+
+/** 最久没用的干净缓冲，没有返回 NULL。调用者持有 cache->lock */
+static struct buffer_head* bcache_victim(struct bcache* cache) {
+    struct list_elem* elem = cache->lru.head.next;
+    while (elem != &cache->lru.tail) {
+        struct buffer_head* bh = elem2entry(struct buffer_head, lru_tag, elem);
+        if (!bh->dirty) {
+            return bh;
+        }
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/** 取一个空闲的缓冲给 lba 用：最久没用的干净缓冲，都脏时先回写。
+ * 回写 BCACHE_FLUSH_TRIES 次仍没有干净缓冲(硬盘坏了)返回 NULL。调用者持有 cache->lock */
+static struct buffer_head* bcache_grab(struct partition* part, struct bcache* cache, uint32_t lba) {
+    for (uint32_t tries = 0; tries <= BCACHE_FLUSH_TRIES; tries++) {
+        if (tries > 0) {
+            __bcache_flush(part, cache);
+        }
+        struct buffer_head* bh = bcache_victim(cache);
+        if (bh != NULL) {
+            bh->lba = lba;
+            list_remove(&bh->lru_tag);
+            list_append(&cache->lru, &bh->lru_tag);
+            return bh;
+        }
+    }
+    printk("%s: metadata writeback keeps failing, no clean buffer\n", part->name);
+    return NULL;
+}
+
+/** 取 lba 的缓冲，不在缓存中则从硬盘读入，读盘失败或没有可用缓冲返回 NULL。调用者持有 cache->lock */
+static struct buffer_head* bcache_get(struct partition* part, struct bcache* cache, uint32_t lba) {
+    struct buffer_head* bh = bcache_lookup(cache, lba);
+    if (bh != NULL) {
+        return bh;
+    }
+    bh = bcache_grab(part, cache, lba);
+    if (bh == NULL) {
+        return NULL;
+    }
+    if (bdev_read(part->bdev, lba, bh->data, 1) != 0) {
+        bh->lba = 0;
+        return NULL;
+    }
+    return bh;
+}
+
+/** 标脏并安排回写。调用者持有 cache->lock */
+static void bcache_mark_dirty(struct partition* part, struct bcache* cache, struct buffer_head* bh) {
+    if (!bh->dirty) {
+        bh->dirty = true;
+        cache->nr_dirty++;
+    }
+    queue_delayed_work(&part->writeback, ms_to_ticks(WRITEBACK_DELAY_MS));
+}
+
+/** 经缓存读一个元数据扇区到 buf，成功返回 0，读盘失败返回 -1 */
+int32_t meta_read(struct partition* part, uint32_t lba, void* buf) {
+    struct bcache* cache = part->bcache;
+    mutex_lock(&cache->lock);
+    struct buffer_head* bh = bcache_get(part, cache, lba);
+    if (bh != NULL) {
+        memcpy(buf, bh->data, SECTOR_SIZE);
+    }
+    mutex_unlock(&cache->lock);
+    return bh != NULL ? 0 : -1;
+}
+
+/** 用 buf 覆盖整个元数据扇区，只改缓存，不必先读盘。成功返回 0，没有可用缓冲返回 -1 */
+int32_t meta_write(struct partition* part, uint32_t lba, const void* buf) {
+    struct bcache* cache = part->bcache;
+    mutex_lock(&cache->lock);
+    struct buffer_head* bh = bcache_lookup(cache, lba);
+    if (bh == NULL) {
+        bh = bcache_grab(part, cache, lba);
+    }
+    if (bh != NULL) {
+        memcpy(bh->data, buf, SECTOR_SIZE);
+        bcache_mark_dirty(part, cache, bh);
+    }
+    mutex_unlock(&cache->lock);
+    return bh != NULL ? 0 : -1;
+}
+
+/** 改写元数据扇区中 [off, off+len) 的部分，扇区不在缓存时先读入。成功返回 0，读盘失败返回 -1 */
+int32_t meta_update(struct partition* part, uint32_t lba, uint32_t off, const void* src, uint32_t len) {
+    ASSERT(off + len <= SECTOR_SIZE);
+    struct bcache* cache = part->bcache;
+    mutex_lock(&cache->lock);
+    struct buffer_head* bh = bcache_get(part, cache, lba);
+    if (bh != NULL) {
+        memcpy(bh->data + off, src, len);
+        bcache_mark_dirty(part, cache, bh);
+    }
+    mutex_unlock(&cache->lock);
+    return bh != NULL ? 0 : -1;
+}
+
+/** lba 在缓存中时复制到 buf 并返回 true，不读盘。供绕过缓存读盘的路径(预读)先取较新的版本 */
+bool meta_peek(struct partition* part, uint32_t lba, void* buf) {
+    struct bcache* cache = part->bcache;
+    mutex_lock(&cache->lock);
+    struct buffer_head* bh = bcache_lookup(cache, lba);
+    if (bh != NULL) {
+        memcpy(buf, bh->data, SECTOR_SIZE);
+    }
+    mutex_unlock(&cache->lock);
+    return bh != NULL;
+}
+
+/** lba 是否在缓存中，不读盘 */
+bool meta_cached(struct partition* part, uint32_t lba) {
+    struct bcache* cache = part->bcache;
+    mutex_lock(&cache->lock);
+    bool cached = bcache_lookup(cache, lba) != NULL;
+    mutex_unlock(&cache->lock);
+    return cached;
+}
+
+/** 把别的路径(预读)刚从硬盘读到的扇区 lba 作为干净的缓冲放进缓存。
+ * 已在缓存中的不覆盖，缓存中的可能更新；只占用干净的缓冲，不为此回写 */
+void meta_fill(struct partition* part, uint32_t lba, const void* buf) {
+    struct bcache* cache = part->bcache;
+    mutex_lock(&cache->lock);
+    if (bcache_lookup(cache, lba) == NULL) {
+        struct buffer_head* bh = bcache_victim(cache);
+        if (bh != NULL) {
+            bh->lba = lba;
+            memcpy(bh->data, buf, SECTOR_SIZE);
+            list_remove(&bh->lru_tag);
+            list_append(&cache->lru, &bh->lru_tag);
+        }
+    }
+    mutex_unlock(&cache->lock);
+}
+
+/** 回写所有脏扇区并等待完成，由分区的回写工作调用 */
+void bcache_flush(struct partition* part) {
+    struct bcache* cache = part->bcache;
+    mutex_lock(&cache->lock);
+    __bcache_flush(part, cache);
+    mutex_unlock(&cache->lock);
+}
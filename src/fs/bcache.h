@@ -0,0 +1,41 @@
+#ifndef __FS_BCACHE_H
+#define __FS_BCACHE_H
+#include "stdint.h"
+#include "list.h"
+#include "sync.h"
+#include "blkdev.h"
+#include "fs.h"
+
+#define BCACHE_BUFS     64      // 每个分区缓存的元数据扇区数
+#define BCACHE_FLUSH_TRIES 3    // 缓冲都脏时最多回写几次，仍写不出去就让操作失败
+
+/* 一个缓存的元数据扇区 */
+struct buffer_head {
+    struct list_elem lru_tag;   // 在 lru 中的结点，越靠后越是最近用过
+    uint32_t lba;               // 0 表示空，分区的元数据不会在 0 号扇区
+    bool dirty;                 // 比硬盘上的新，等待回写
+    struct bio bio;             // 回写用
+    uint8_t data[SECTOR_SIZE];
+};
+
+/* 分区的元数据缓存：inode 表、目录块、间接块表经此读写。
+ * 写只改缓存并标脏，同一扇区的多次修改由分区的回写工作合成一次写 */
+struct bcache {
+    struct mutex_t lock;
+    struct list lru;
+    uint32_t nr_dirty;
+    struct buffer_head bufs[BCACHE_BUFS];
+};
+
+struct partition;
+
+bool bcache_init(struct partition* part);
+int32_t meta_read(struct partition* part, uint32_t lba, void* buf);
+int32_t meta_write(struct partition* part, uint32_t lba, const void* buf);
+int32_t meta_update(struct partition* part, uint32_t lba, uint32_t off, const void* src, uint32_t len);
+bool meta_peek(struct partition* part, uint32_t lba, void* buf);
+bool meta_cached(struct partition* part, uint32_t lba);
+void meta_fill(struct partition* part, uint32_t lba, const void* buf);
+void bcache_flush(struct partition* part);
+
+#endif
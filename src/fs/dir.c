@@ -9,6 +9,10 @@
 #include "string.h"
 #include "interrupt.h"
 #include "super_block.h"
+#include "readahead.h"
+#include "bcache.h"
+
+#define DIR_RA_START    2       // 目录扫描到第几块才可能建立预读
 
 struct dir root_dir;             // 根目录
 
@@ -26,42 +30,63 @@ struct dir* dir_open(struct partition* part, uint32_t inode_no) {
     return pdir;
 }
 
-/** 在 pdir 目录内寻找名为 name 的文件或目录，找到后将其目录项存入dir_e，返回true */
+/** 在 pdir 目录内寻找名为 name 的文件或目录，找到后将其目录项存入dir_e，返回true。
+ * 目录块经元数据缓存读，常用目录的块留在缓存里。目录超过 DIR_RA_START 块、
+ * 扫到缓存中没有的块时才建立预读，从这块起把后面的块提前放进队列，读到的块也放进缓存 */
 bool search_dir_entry(struct partition* part, struct dir* pdir, \
                       const char* name, struct dir_entry* dir_e) {
     uint32_t block_cnt = 140;     // 12个直接块+128个一级间接块=140块
-    // 12个直接块 + 128个间接块，每个指针4字节，共560字节
-    uint32_t* all_blocks = (uint32_t*)sys_malloc(560);
-    if (all_blocks == NULL) {
-        printk("search_dir_entry: sys_malloc for all_blocks failed");
-        return false;
-    }
-    // 填充 all_blocks：pdir 的所有数据块地址
-    uint32_t block_idx = 0;
-    while (block_idx < 12) {
-        all_blocks[block_idx] = pdir->inode->i_sectors[block_idx];
-        block_idx++;
-    } 
-    if (pdir->inode->i_sectors[12] != 0) {    // 若含有一级间接块表
-        ide_read(part->my_disk, pdir->inode->i_sectors[12], all_blocks + 12, 1);
-    }
+    struct inode* inode = pdir->inode;
+    struct readahead* ra = NULL;
+    uint32_t* indirect = NULL;    // 建立预读前用的间接块表
         
     // 写目录项时保证目录项不跨扇区，便于读目录项时处理；
     // 每次检索一个数据块，申请1个扇区的内存
     uint8_t* buf = (uint8_t*)sys_malloc(SECTOR_SIZE);
     uint32_t dir_entry_size = part->sb->dir_entry_size;
     uint32_t dir_entry_cnt = SECTOR_SIZE / dir_entry_size; 
+    bool found = false;
 
     struct dir_entry* p_de;    // 一会从硬盘中读数据块到该地址
     // 在所有块中查找目录项 
-    block_idx = 0;        
-    while (block_idx < block_cnt) {
+    uint32_t block_idx = 0;        
+    while (block_idx < block_cnt && !found) {
+        if (block_idx == 12 && inode->i_sectors[12] == 0) {    // 没有间接块
+            break;
+        }
+        uint32_t lba;
+        if (ra != NULL) {
+            lba = ra->blocks[block_idx];
+        } else if (block_idx < 12) {
+            lba = inode->i_sectors[block_idx];
+        } else {
+            if (indirect == NULL) {
+                indirect = (uint32_t*)sys_malloc(BLOCK_SIZE);
+                if (indirect == NULL || meta_read(part, inode->i_sectors[12], indirect) != 0) {
+                    break;
+                }
+            }
+            lba = indirect[block_idx - 12];
+        }
         // 块地址为0时表示该块中无数据，继续在其它块中找（删除操作可能导致数据块不连续）
-        if (all_blocks[block_idx] == 0) {
+        if (lba == 0) {
+            block_idx++;
+            continue;
+        }
+        int32_t err = 0;
+        if (ra != NULL) {
+            err = ra_read_block(ra, block_idx, buf);
+        } else if (block_idx < DIR_RA_START) {
+            err = meta_read(part, lba, buf);
+        } else if (!meta_peek(part, lba, buf)) {
+            // 本块不在缓存中，后面的块多半也不在，从本块起顺序预读
+            ra = ra_create(part, inode, block_idx, true);
+            err = ra != NULL ? ra_read_block(ra, block_idx, buf) : meta_read(part, lba, buf);
+        }
+        if (err != 0) {
             block_idx++;
             continue;
         }
-        ide_read(part->my_disk, all_blocks[block_idx], buf, 1);
         
         p_de = (struct dir_entry*)buf; 
         uint32_t dir_entry_idx = 0;
@@ -69,9 +94,8 @@ bool search_dir_entry(struct partition* part, struct dir* pdir, \
         while (dir_entry_idx < dir_entry_cnt) {
             if (!strcmp(p_de->filename, name)) {
                 memcpy(dir_e, p_de, dir_entry_size);
-                sys_free(buf);
-                sys_free(all_blocks);
-                return true;
+                found = true;
+                break;
             }
             dir_entry_idx++;
             p_de++;
@@ -80,8 +104,13 @@ bool search_dir_entry(struct partition* part, struct dir* pdir, \
         memset(buf, 0, SECTOR_SIZE);     
     }
     sys_free(buf);
-    sys_free(all_blocks);
-    return false;
+    if (indirect != NULL) {
+        sys_free(indirect);
+    }
+    if (ra != NULL) {
+        ra_destroy(ra);     // 等还在路上的预读结束，它们写的是 ra 里的缓冲区
+    }
+    return found;
 }
 
 /** 关闭目录 */
@@ -121,6 +150,11 @@ bool sync_dir_entry(struct dir* parent_dir, struct dir_entry* p_de, void* io_buf
         all_blocks[block_idx] = dir_inode->i_sectors[block_idx];
         block_idx++;
     }
+    if (dir_inode->i_sectors[12] != 0) {    // 已有一级间接块表时读入间接块地址
+        if (meta_read(cur_part, dir_inode->i_sectors[12], all_blocks + 12) != 0) {
+            return false;
+        }
+    }
     
     struct dir_entry* dir_e = (struct dir_entry*)io_buf; // 用来在 buf 中遍历目录项
     int32_t block_bitmap_idx;
@@ -138,7 +172,7 @@ bool sync_dir_entry(struct dir* parent_dir, struct dir_entry* p_de, void* io_buf
             }
             // 每分配一个块就同步一次 block_bitmap
             block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-            bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
+            bitmap_mark_dirty(cur_part, block_bitmap_idx, BLOCK_BITMAP);
             
             block_bitmap_idx = -1;
             if (block_idx < 12) {   // 若是直接块
@@ -149,41 +183,51 @@ bool sync_dir_entry(struct dir* parent_dir, struct dir_entry* p_de, void* io_buf
                 if (block_lba == -1) {
                     block_bitmap_idx = dir_inode->i_sectors[12] - cur_part->sb->data_start_lba;
                     bitmap_set(&cur_part->block_bitmap, block_bitmap_idx, 0); 
-                    bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP); // my opinion
+                    bitmap_mark_dirty(cur_part, block_bitmap_idx, BLOCK_BITMAP); // my opinion
                     dir_inode->i_sectors[12] = 0;
                     printk("block full\n");
                     return false;
                 }
                  
                 block_bitmap_idx = block_lba - cur_part->sb->data_start_lba; 
-                bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
+                bitmap_mark_dirty(cur_part, block_bitmap_idx, BLOCK_BITMAP);
                 
                 all_blocks[12] = block_lba;
                 // 更新一级间接块表
-                ide_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
+                if (meta_write(cur_part, dir_inode->i_sectors[12], all_blocks + 12) != 0) {
+                    return false;
+                }
             } else {            // 若是间接块未分配
                 all_blocks[block_idx] = block_lba;
                 // 更新一级间接块表
-                ide_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
+                if (meta_write(cur_part, dir_inode->i_sectors[12], all_blocks + 12) != 0) {
+                    return false;
+                }
             }
             
             /* 再将新目录项p_de写入新分配的间接块 */
             memset(io_buf, 0, 512);
             memcpy(io_buf, p_de, dir_entry_size);
-            ide_write(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
+            if (meta_write(cur_part, all_blocks[block_idx], io_buf) != 0) {
+                return false;
+            }
             dir_inode->i_size += dir_entry_size;
             return true;
         }
         
         /* 若第block_idx块已存在,将其读进内存,然后在该块中查找空目录项 */
-        ide_read(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
+        if (meta_read(cur_part, all_blocks[block_idx], io_buf) != 0) {
+            return false;
+        }
         /* 在扇区内查找空目录项 */
         uint8_t dir_entry_idx = 0;
         while (dir_entry_idx < dir_entrys_per_sec) {
             if ((dir_e + dir_entry_idx)->f_type == FT_UNKNOWN) {    
                 // FT_UNKNOWN 为0，无论是初始化或是删除文件后，都会将 f_type 置为 FT_UNKNOWN
                 memcpy(dir_e + dir_entry_idx, p_de, dir_entry_size);
-                ide_write(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
+                if (meta_write(cur_part, all_blocks[block_idx], io_buf) != 0) {
+                    return false;
+                }
                 dir_inode->i_size += dir_entry_size;
                 return true;
             }
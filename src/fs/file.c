@@ -9,8 +9,13 @@
 #include "string.h"
 #include "thread.h"
 #include "global.h"
+#include "timer.h"
+#include "blkdev.h"
+#include "readahead.h"
+#include "bcache.h"
 
 #define DEFAULT_SECS 1
+#define WRITEBACK_BATCH 16     // 位图回写一次最多同时提交的扇区数
 
 /** 文件表 */
 struct file file_table[MAX_FILE_OPEN];
@@ -33,7 +38,7 @@ int32_t get_free_slot_in_global() {
 
 /** 将全局描述符下标安装到 PCB 的文件描述符数组 fd_table 中。成功返回下标,失败返回-1 */
 int32_t pcb_fd_install(int32_t globa_fd_idx) {
-    struct task_struct* cur = running_thread();
+    struct task_struct* cur = running_thread()->leader;   // 进程内的线程共用文件描述符
     uint8_t local_fd_idx = 3; // 跨过stdin,stdout,stderr
     while (local_fd_idx < MAX_FILES_OPEN_PER_PROC) {
         if (cur->fd_table[local_fd_idx] == -1) {    // -1表示free_slot,可用
@@ -71,26 +76,72 @@ int32_t block_bitmap_alloc(struct partition* part) {
     return (part->sb->data_start_lba + bit_idx);
 }
 
-/** 将内存中 bitmap 第 bit_idx 位所在的扇区 同步到硬盘 */
-void bitmap_sync(struct partition* part, uint32_t bit_idx, uint8_t btmp_type) {
+/** 求内存中 bitmap 第 bit_idx 位所在扇区的 lba 及其在内存中的位置 */
+static uint8_t* bitmap_sec_locate(struct partition* part, uint32_t bit_idx, uint8_t btmp_type, uint32_t* sec_lba) {
     uint32_t off_sec = bit_idx / 4096;          // 本inode索引相对于位图的扇区偏移量
     uint32_t off_size = off_sec * BLOCK_SIZE;   // 本inode索引相对于位图的字节偏移量
-    uint32_t sec_lba;
-    uint8_t* bitmap_off;
     
     // 需要被同步到硬盘的位图只有 inode_bitmap 和 block_bitmap
-    switch (btmp_type) {
-        case INODE_BITMAP:
-            sec_lba = part->sb->inode_bitmap_lba + off_sec;
-            bitmap_off = part->inode_bitmap.bits + off_size;
-            break;
-            
-        case BLOCK_BITMAP:
-            sec_lba = part->sb->block_bitmap_lba + off_sec;
-            bitmap_off = part->block_bitmap.bits + off_size;
-            break;
+    if (btmp_type == INODE_BITMAP) {
+        *sec_lba = part->sb->inode_bitmap_lba + off_sec;
+        return part->inode_bitmap.bits + off_size;
+    }
+    *sec_lba = part->sb->block_bitmap_lba + off_sec;
+    return part->block_bitmap.bits + off_size;
+}
+
+/** 将内存中 bitmap 第 bit_idx 位所在的扇区 同步到硬盘 */
+void bitmap_sync(struct partition* part, uint32_t bit_idx, uint8_t btmp_type) {
+    uint32_t sec_lba;
+    uint8_t* bitmap_off = bitmap_sec_locate(part, bit_idx, btmp_type, &sec_lba);
+    bdev_write(part->bdev, sec_lba, bitmap_off, 1);
+}
+
+/** 标记位图中 bit_idx 所在扇区待回写，由分区的回写工作稍后写入硬盘 */
+void bitmap_mark_dirty(struct partition* part, uint32_t bit_idx, uint8_t btmp_type) {
+    uint32_t dirty_idx = bit_idx / BITS_PER_SECTOR;
+    if (btmp_type == INODE_BITMAP) {    // inode 位图的扇区排在块位图之后
+        dirty_idx += part->sb->block_bitmap_sects;
+    }
+    enum intr_status old_status = intr_disable();
+    bitmap_set(&part->dirty_btmp_secs, dirty_idx, 1);
+    intr_set_status(old_status);
+    queue_delayed_work(&part->writeback, ms_to_ticks(WRITEBACK_DELAY_MS));
+}
+
+/** 写回所有被标记的位图扇区，由分区的回写工作调用。
+ * 每攒够一批就一起提交再一起等待，相邻的脏扇区在请求队列里会合并成一条命令 */
+void bitmap_writeback(struct partition* part) {
+    struct bio bios[WRITEBACK_BATCH];
+    uint32_t nr = 0;
+    uint32_t block_secs = part->sb->block_bitmap_sects;
+    uint32_t total_secs = block_secs + part->sb->inode_bitmap_sects;
+    for (uint32_t dirty_idx = 0; dirty_idx < total_secs; dirty_idx++) {
+        enum intr_status old_status = intr_disable();
+        bool dirty = bitmap_scan_test(&part->dirty_btmp_secs, dirty_idx);
+        bitmap_set(&part->dirty_btmp_secs, dirty_idx, 0);   // 先清标记，写的过程中再被修改会重新标记
+        intr_set_status(old_status);
+        if (!dirty) {
+            continue;
+        }
+        uint32_t sec_lba;
+        uint8_t* bitmap_off;
+        if (dirty_idx < block_secs) {
+            bitmap_off = bitmap_sec_locate(part, dirty_idx * BITS_PER_SECTOR, BLOCK_BITMAP, &sec_lba);
+        } else {
+            bitmap_off = bitmap_sec_locate(part, (dirty_idx - block_secs) * BITS_PER_SECTOR, INODE_BITMAP, &sec_lba);
+        }
+        bio_init(&bios[nr], part->bdev, sec_lba, bitmap_off, 1, true);
+        bio_submit(&bios[nr]);
+        if (++nr == WRITEBACK_BATCH) {
+            while (nr > 0) {
+                bio_wait(&bios[--nr]);
+            }
+        }
+    }
+    while (nr > 0) {
+        bio_wait(&bios[--nr]);
     }
-    ide_write(part->my_disk, sec_lba, bitmap_off, 1);
 }
 
 /** 创建文件，若成功 返回文件描述符，否则返回 -1 */
@@ -128,6 +179,7 @@ int32_t file_create(struct dir* parent_dir, const char* filename, uint8_t flag)
     }
     
     file_table[fd_idx].fd_inode = new_file_inode;
+    file_table[fd_idx].fd_ra = NULL;
     file_table[fd_idx].fd_pos = 0;
     file_table[fd_idx].fd_flag = flag;
     file_table[fd_idx].fd_inode->write_deny = false;
@@ -145,20 +197,20 @@ int32_t file_create(struct dir* parent_dir, const char* filename, uint8_t flag)
         goto rollback;
     }
     
-    memset(io_buf, 0, 1024);
-    /* b 将父目录i结点的内容同步到硬盘 */
-    inode_sync(cur_part, parent_dir->inode, io_buf);
+    /* b 父目录i结点的内容稍后回写到硬盘 */
+    inode_mark_dirty(cur_part, parent_dir->inode);
     
-    memset(io_buf, 0, 1024);
-    /* c 将新创建文件的i结点内容同步到硬盘 */
-    inode_sync(cur_part, new_file_inode, io_buf);
+    /* c 新创建文件的i结点内容稍后回写到硬盘 */
+    inode_mark_dirty(cur_part, new_file_inode);
     
-    /* d 将inode_bitmap位图同步到硬盘 */
-    bitmap_sync(cur_part, inode_no, INODE_BITMAP);
+    /* d inode_bitmap位图稍后回写到硬盘 */
+    bitmap_mark_dirty(cur_part, inode_no, INODE_BITMAP);
     
     /* e 将创建的文件i结点添加到open_inodes链表 */
+    down_write(&cur_part->inode_lock);
     list_push(&cur_part->open_inodes, &new_file_inode->inode_tag);
     new_file_inode->i_open_cnts = 1;
+    up_write(&cur_part->inode_lock);
     
     sys_free(io_buf);
     return pcb_fd_install(fd_idx);
@@ -190,6 +242,7 @@ int32_t file_open(uint32_t inode_no, uint8_t flag) {
         return -1;
     }
     file_table[fd_idx].fd_inode = inode_open(cur_part, inode_no);
+    file_table[fd_idx].fd_ra = NULL;
     file_table[fd_idx].fd_pos = 0;      // 每次打开文件，让文件内的指针指向开头
     file_table[fd_idx].fd_flag = flag;
     bool* write_deny = &file_table[fd_idx].fd_inode->write_deny;
@@ -215,9 +268,98 @@ int32_t file_close(struct file* file) {
         return -1;
     }
     file->fd_inode->write_deny = false;
+    if (file->fd_ra != NULL) {
+        ra_destroy(file->fd_ra);
+        file->fd_ra = NULL;
+    }
     inode_close(file->fd_inode);
     file->fd_inode = NULL;   // 使文件结构可用
     return 0;
 }
 
 
+
+/** 从 inode 的 pos 处读至多 count 字节到内核缓冲区 buf，读到文件尾为止。
+ * ra 不为 NULL 时经预读窗口读块，否则逐块同步读。返回读到的字节数，读硬盘出错返回 -1 */
+static int32_t file_read_range(struct inode* inode, struct readahead* ra, uint32_t pos, void* buf, uint32_t count) {
+    if (pos >= inode->i_size) {
+        return 0;
+    }
+    if (count > inode->i_size - pos) {
+        count = inode->i_size - pos;
+    }
+    uint8_t* io_buf = kmalloc(BLOCK_SIZE);
+    if (io_buf == NULL) {
+        return -1;
+    }
+    uint32_t* indirect = NULL;      // 一级间接块表，用到时才读
+    uint8_t* dst = buf;
+    uint32_t done = 0;
+    int32_t ret = -1;
+    while (done < count) {
+        uint32_t block_idx = (pos + done) / BLOCK_SIZE;
+        uint32_t offset = (pos + done) % BLOCK_SIZE;
+        uint32_t chunk = BLOCK_SIZE - offset;
+        if (chunk > count - done) {
+            chunk = count - done;
+        }
+
+        uint32_t lba;
+        if (ra != NULL) {
+            lba = block_idx < RA_FILE_BLKS ? ra->blocks[block_idx] : 0;
+        } else if (block_idx < 12) {
+            lba = inode->i_sectors[block_idx];
+        } else {
+            if (indirect == NULL) {
+                indirect = kmalloc(BLOCK_SIZE);
+                if (indirect == NULL || 
+                    meta_read(cur_part, inode->i_sectors[12], indirect) != 0) {
+                    goto out;
+                }
+            }
+            lba = indirect[block_idx - 12];
+        }
+
+        // 整块直接读进 buf，省一次复制
+        uint8_t* blk_buf = chunk == BLOCK_SIZE ? dst + done : io_buf;
+        if (lba == 0) {                 // 未分配的块读作 0
+            memset(dst + done, 0, chunk);
+        } else {
+            int32_t err = ra != NULL ? ra_read_block(ra, block_idx, blk_buf)
+                                     : bdev_read(cur_part->bdev, lba, blk_buf, 1);
+            if (err != 0) {
+                goto out;
+            }
+            if (blk_buf == io_buf) {
+                memcpy(dst + done, io_buf + offset, chunk);
+            }
+        }
+        done += chunk;
+    }
+    ret = done;
+out:
+    if (indirect != NULL) {
+        kfree(indirect);
+    }
+    kfree(io_buf);
+    return ret;
+}
+
+/** 从 inode 的 pos 处读至多 count 字节到内核缓冲区 buf，不预读，用于随机访问。
+ * 返回读到的字节数，读硬盘出错返回 -1 */
+int32_t file_read_at(struct inode* inode, uint32_t pos, void* buf, uint32_t count) {
+    return file_read_range(inode, NULL, pos, buf, count);
+}
+
+/** 从文件当前位置读 count 字节到内核缓冲区 buf 并推进位置，返回读到的字节数，出错返回 -1 */
+int32_t file_read(struct file* file, void* buf, uint32_t count) {
+    // 第一次读时建立预读状态，建不起来就不预读
+    if (file->fd_ra == NULL) {
+        file->fd_ra = ra_create(cur_part, file->fd_inode, file->fd_pos / BLOCK_SIZE, false);
+    }
+    int32_t bytes = file_read_range(file->fd_inode, file->fd_ra, file->fd_pos, buf, count);
+    if (bytes > 0) {
+        file->fd_pos += bytes;
+    }
+    return bytes;
+}
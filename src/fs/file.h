@@ -12,6 +12,7 @@ struct file {
     uint32_t fd_pos; 	// 记录当前文件操作的偏移地址，0～(文件大小-1)
     uint32_t fd_flag;
     struct inode* fd_inode;
+    struct readahead* fd_ra;    // 顺序读的预读状态，第一次读时建立
 };
 
 /** 标准输入输出描述符 */
@@ -35,8 +36,12 @@ int32_t block_bitmap_alloc(struct partition* part);
 int32_t file_create(struct dir* parent_dir, const char* filename, uint8_t flag);
 int32_t file_open(uint32_t inode_no, uint8_t flag);
 int32_t file_close(struct file* file);
+int32_t file_read_at(struct inode* inode, uint32_t pos, void* buf, uint32_t count);
+int32_t file_read(struct file* file, void* buf, uint32_t count);
 
 void    bitmap_sync(struct partition* part, uint32_t bit_idx, uint8_t btmp);
+void    bitmap_mark_dirty(struct partition* part, uint32_t bit_idx, uint8_t btmp_type);
+void    bitmap_writeback(struct partition* part);
 int32_t get_free_slot_in_global(void);
 int32_t pcb_fd_install(int32_t globa_fd_idx);
 
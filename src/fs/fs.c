@@ -11,49 +11,81 @@
 #include "global.h"
 #include "debug.h"
 #include "memory.h"
+#include "uaccess.h"
+#include "bcache.h"
 
 struct partition* cur_part;     // 默认情况下操作的是哪个分区
 
-/** 在分区链表中找到名为part_name的分区,并将其指针赋值给cur_part */
+/** 分区的回写工作：把推迟的元数据扇区和位图扇区写入硬盘 */
+static void partition_writeback(void* arg) {
+    struct partition* part = arg;
+    bcache_flush(part);
+    bitmap_writeback(part);
+}
+
+/** 立即回写分区上所有推迟的修改并等待完成，再让硬盘把缓存写到盘片上。
+ * 卸载分区或关机前必须调用；目前分区挂载后不会卸载，没有调用它的卸载路径 */
+void partition_sync(struct partition* part) {
+    flush_delayed_work(&part->writeback);
+    bdev_flush(part->bdev);
+}
+
+/** 挂载分区 part：读入超级块和位图，建立元数据缓存，并设为当前分区 cur_part */
+static void partition_mount(struct partition* part) {
+    cur_part = part;
+    struct block_device* bdev = cur_part->bdev;
+    
+    // sb_buf用来存储从硬盘上读入的超级块  
+    struct super_block* sb_buf = (struct super_block*)sys_malloc(SECTOR_SIZE); 
+    // 在内存中创建分区cur_part的超级块  
+    cur_part->sb = (struct super_block*)sys_malloc(sizeof(struct super_block));
+    if (cur_part->sb == NULL || sb_buf == NULL)  
+        PANIC("alloc memory failed!"); 
+    
+    // 读入超级块 
+    memset(sb_buf, 0, SECTOR_SIZE);
+    bdev_read(bdev, cur_part->start_lba + 1, sb_buf, 1); 
+    // 把sb_buf中超级块的信息复制到分区的超级块sb中 
+    memcpy(cur_part->sb, sb_buf, sizeof(struct super_block));
+    
+    // 将硬盘上的块位图读入到内存  
+    cur_part->block_bitmap.bits = (uint8_t*)sys_malloc(sb_buf->block_bitmap_sects * SECTOR_SIZE);
+    if (cur_part->block_bitmap.bits == NULL) 
+        PANIC("alloc memory failed!");
+    cur_part->block_bitmap.btmp_bytes_len = sb_buf->block_bitmap_sects * SECTOR_SIZE;
+    // 从硬盘上读入块位图到分区的block_bitmap.bits  
+    bdev_read(bdev, sb_buf->block_bitmap_lba, cur_part->block_bitmap.bits, sb_buf->block_bitmap_sects);
+    
+    // 将硬盘上的inode位图读入到内存     
+    cur_part->inode_bitmap.bits = (uint8_t*)sys_malloc(sb_buf->inode_bitmap_sects * SECTOR_SIZE);
+    if (cur_part->inode_bitmap.bits == NULL) 
+        PANIC("alloc memory failed!");
+    cur_part->inode_bitmap.btmp_bytes_len = sb_buf->inode_bitmap_sects * SECTOR_SIZE;
+    // 从硬盘上读入inode位图到分区的inode_bitmap.bits 
+    bdev_read(bdev, sb_buf->inode_bitmap_lba, cur_part->inode_bitmap.bits, sb_buf->inode_bitmap_sects);
+     
+    list_init(&cur_part->open_inodes);
+    rwsem_init(&cur_part->inode_lock);
+    rwsem_init(&cur_part->dir_lock);
+
+    uint32_t btmp_secs = sb_buf->block_bitmap_sects + sb_buf->inode_bitmap_sects;
+    cur_part->dirty_btmp_secs.btmp_bytes_len = DIV_ROUND_UP(btmp_secs, 8);
+    cur_part->dirty_btmp_secs.bits = (uint8_t*)sys_malloc(cur_part->dirty_btmp_secs.btmp_bytes_len);
+    if (cur_part->dirty_btmp_secs.bits == NULL)
+        PANIC("alloc memory failed!");
+    bitmap_init(&cur_part->dirty_btmp_secs);
+    if (!bcache_init(cur_part))
+        PANIC("alloc memory failed!");
+    delayed_work_init(&cur_part->writeback, partition_writeback, cur_part);
+    printk("MOUNT %s DONE!\n", part->name);   
+}
+
+/** 在分区链表中找到名为part_name的分区并挂载 */
 static bool mount_partition(struct list_elem* pelem, int arg) {
     char* part_name = (char*)arg;
     struct partition* part = elem2entry(struct partition, part_tag, pelem);
     if (!strcmp(part->name, part_name)) {
-        cur_part = part;
-        struct disk* hd = cur_part->my_disk;
-        
-        // sb_buf用来存储从硬盘上读入的超级块  
-        struct super_block* sb_buf = (struct super_block*)sys_malloc(SECTOR_SIZE); 
-        // 在内存中创建分区cur_part的超级块  
-        cur_part->sb = (struct super_block*)sys_malloc(sizeof(struct super_block));
-        if (cur_part->sb == NULL || sb_buf == NULL)  
-            PANIC("alloc memory failed!"); 
-        
-        // 读入超级块 
-        memset(sb_buf, 0, SECTOR_SIZE);
-        ide_read(hd, cur_part->start_lba + 1, sb_buf, 1); 
-        // 把sb_buf中超级块的信息复制到分区的超级块sb中 
-        memcpy(cur_part->sb, sb_buf, sizeof(struct super_block));
-        
-        // 将硬盘上的块位图读入到内存  
-        cur_part->block_bitmap.bits = (uint8_t*)sys_malloc(sb_buf->block_bitmap_sects * SECTOR_SIZE);
-        if (cur_part->block_bitmap.bits == NULL) 
-            PANIC("alloc memory failed!");
-        cur_part->block_bitmap.btmp_bytes_len = sb_buf->block_bitmap_sects * SECTOR_SIZE;
-        // 从硬盘上读入块位图到分区的block_bitmap.bits  
-        ide_read(hd, sb_buf->block_bitmap_lba, cur_part->block_bitmap.bits, sb_buf->block_bitmap_sects);
-        
-        // 将硬盘上的inode位图读入到内存     
-        cur_part->inode_bitmap.bits = (uint8_t*)sys_malloc(sb_buf->inode_bitmap_sects * SECTOR_SIZE);
-        if (cur_part->inode_bitmap.bits == NULL) 
-            PANIC("alloc memory failed!");
-        cur_part->inode_bitmap.btmp_bytes_len = sb_buf->inode_bitmap_sects * SECTOR_SIZE;
-        // 从硬盘上读入inode位图到分区的inode_bitmap.bits 
-        ide_read(hd, sb_buf->inode_bitmap_lba, cur_part->inode_bitmap.bits, sb_buf->inode_bitmap_sects);
-         
-        list_init(&cur_part->open_inodes);
-        printk("MOUNT %s DONE!\n", part->name);   
- 
+        partition_mount(part);
         // 使 list_traversal 停止遍历 
         return true;
     }
@@ -67,7 +99,7 @@ static void partition_format(struct partition* part) {
     uint32_t super_block_sects = 1; // SB
     
     uint32_t inode_bitmap_sects = DIV_ROUND_UP(MAX_FILES_PER_PART, BITS_PER_SECTOR);  
-    uint32_t inode_table_sects = DIV_ROUND_UP(((sizeof(struct inode) * MAX_FILES_PER_PART)), SECTOR_SIZE);
+    uint32_t inode_table_sects = DIV_ROUND_UP(((sizeof(struct disk_inode) * MAX_FILES_PER_PART)), SECTOR_SIZE);
     
     uint32_t used_sects = boot_sector_sects + super_block_sects + inode_bitmap_sects + inode_table_sects;
     uint32_t free_sects = part->sec_cnt - used_sects;
@@ -106,8 +138,8 @@ static void partition_format(struct partition* part) {
         sb.inode_table_lba, sb.inode_table_sects);
     printk("   data_start_lba:0x%x\n", sb.data_start_lba);
 
-    struct disk* hd = part->my_disk;
-    ide_write(hd, part->start_lba + 1, &sb, 1);
+    struct block_device* bdev = part->bdev;
+    bdev_write(bdev, part->start_lba + 1, &sb, 1);
     printk("   super_block_lba:0x%x\n", part->start_lba + 1);
     
     // 找出数据量最大的元信息，其尺寸作为缓冲区的尺寸
@@ -136,7 +168,7 @@ static void partition_format(struct partition* part) {
     while (bit_idx < block_bitmap_last_bit) {
         buf[block_bitmap_last_byte] &= ~(1 << bit_idx++); 
     }
-    ide_write(hd, sb.block_bitmap_lba, buf, sb.block_bitmap_sects);
+    bdev_write(bdev, sb.block_bitmap_lba, buf, sb.block_bitmap_sects);
     memset(buf, 0, buf_size);
 
     // 将 inode位图 初始化并写入 sb.inode_bitmap_lba  
@@ -144,16 +176,16 @@ static void partition_format(struct partition* part) {
     buf[0] |= 1;
     // inode_table 大小为 4096，故 inode_bitmap 恰好占用1扇区，没有多余无效位
     // 最好按上面的步骤走，但是本系统就固定最多 4096 文件，写死吧
-    ide_write(hd, sb.inode_bitmap_lba, buf, sb.inode_bitmap_sects);
+    bdev_write(bdev, sb.inode_bitmap_lba, buf, sb.inode_bitmap_sects);
     memset(buf, 0, buf_size);
 
     // 将 inode数组 初始化并写入 sb.inode_table_lba 
     // 准备 根目录的 inode
-    struct inode* i = (struct inode*)buf;
+    struct disk_inode* i = (struct disk_inode*)buf;
     i->i_size = sb.dir_entry_size * 2;   // .和..
     i->i_no = 0;
     i->i_sectors[0] = sb.data_start_lba; 
-    ide_write(hd, sb.inode_table_lba, buf, sb.inode_table_sects);
+    bdev_write(bdev, sb.inode_table_lba, buf, sb.inode_table_sects);
     memset(buf, 0, buf_size);
 
     // 将 根目录 初始化，其目录项列表写入 sb.data_start_lba    
@@ -168,7 +200,7 @@ static void partition_format(struct partition* part) {
     memcpy(p_de->filename, "..", 2);
     p_de->i_no = 0;   // 根目录的父目录 是根目录
     p_de->f_type = FT_DIRECTORY;
-    ide_write(hd, sb.data_start_lba, buf, 1);
+    bdev_write(bdev, sb.data_start_lba, buf, 1);
     
     printk("   root_dir_lba:0x%x\n", sb.data_start_lba);
     printk("%s format done\n", part->name);
@@ -271,8 +303,8 @@ static int search_file(const char* pathname, struct path_search_record* searched
     return dir_e.i_no;
 }
 
-/** 打开或创建文件成功后,返回文件描述符,否则返回-1 */
-int32_t sys_open(const char* pathname, uint8_t flags) {
+/** 打开或创建文件，调用者持有 dir_lock */
+static int32_t do_open(const char* pathname, uint8_t flags) {
     // 对目录用 dir_open
     if (pathname[strlen(pathname) - 1] == '/') {
         printk("can`t open a directory %s\n", pathname);
@@ -329,9 +361,28 @@ int32_t sys_open(const char* pathname, uint8_t flags) {
     return fd;
 }
 
+/** 打开或创建文件成功后,返回文件描述符,否则返回-1 */
+int32_t sys_open(const char* pathname, uint8_t flags) {
+    // 只读的路径查找可以并发；创建文件要改目录，从查找到安装目录项都须独占，防止重复创建
+    struct rw_semaphore* dir_lock = &cur_part->dir_lock;
+    bool creating = flags & O_CREAT;
+    if (creating) {
+        down_write(dir_lock);
+    } else {
+        down_read(dir_lock);
+    }
+    int32_t fd = do_open(pathname, flags);
+    if (creating) {
+        up_write(dir_lock);
+    } else {
+        up_read(dir_lock);
+    }
+    return fd;
+}
+
 /** 将文件描述符转化为文件表的下标 */
 static uint32_t fd_local2global(uint32_t local_fd) {
-    struct task_struct* cur = running_thread();
+    struct task_struct* cur = running_thread()->leader;
     int32_t global_fd = cur->fd_table[local_fd];
     ASSERT(global_fd >= 0 && global_fd < MAX_FILE_OPEN);
     return (uint32_t)global_fd;
@@ -343,11 +394,62 @@ int32_t sys_close(int32_t fd) {
     if (fd > 2) {
         uint32_t _fd = fd_local2global(fd);
         ret = file_close(&file_table[_fd]);
-        running_thread()->fd_table[fd] = -1; // 使该文件描述符位可用
+        running_thread()->leader->fd_table[fd] = -1; // 使该文件描述符位可用
+        // 关闭时让回写工作立即开始，不等它完成；工作运行前的修改仍合在一次回写中
+        queue_delayed_work(&cur_part->writeback, 0);
     }
     return ret;
 }
 
+/** 当前进程的文件描述符 fd 对应的文件结构，fd 不是打开的普通文件返回 NULL */
+struct file* fd2file(int32_t fd) {
+    if (fd <= stderr_no || fd >= MAX_FILES_OPEN_PER_PROC || running_thread()->leader->fd_table[fd] == -1) {
+        return NULL;
+    }
+    return &file_table[fd_local2global(fd)];
+}
+
+/** 从文件 fd 读 count 字节到用户缓冲区 buf，返回读到的字节数，出错返回 -1。经内核缓冲区分块复制 */
+int32_t sys_read(int32_t fd, void* buf, uint32_t count) {
+    struct file* file = fd2file(fd);
+    if (file == NULL || !access_ok(buf, count, true)) {
+        return -1;
+    }
+    void* kbuf = get_pages(1, PF_KERNEL);
+    if (kbuf == NULL) {
+        return -1;
+    }
+    int32_t done = 0;
+    while ((uint32_t)done < count) {
+        uint32_t chunk = count - done < PG_SIZE ? count - done : PG_SIZE;
+        int32_t bytes = file_read(file, kbuf, chunk);
+        if (bytes < 0) {
+            done = done == 0 ? -1 : done;
+            break;
+        }
+        if (copy_to_user((uint8_t*)buf + done, kbuf, bytes) != 0) {
+            done = -1;
+            break;
+        }
+        done += bytes;
+        if ((uint32_t)bytes < chunk) {      // 到文件尾
+            break;
+        }
+    }
+    free_pages(kbuf, 1, PF_KERNEL);
+    return done;
+}
+
+/** 打开刚挂载的分区的根目录，清空全局文件表 */
+static void filesys_start(struct partition* part) {
+    open_root_dir(part);
+    uint32_t fd_idx = 0;
+    while (fd_idx < MAX_FILE_OPEN) {
+        file_table[fd_idx].fd_ra = NULL;
+        file_table[fd_idx++].fd_inode = NULL;
+    }
+}
+
 /* 在磁盘上搜索文件系统,若没有则格式化分区创建文件系统 */
 void filesys_init() {
     uint8_t channel_no = 0, dev_no, part_idx = 0;
@@ -376,7 +478,7 @@ void filesys_init() {
                 if (part->sec_cnt) {  
                     memset(sb_buf, 0, SECTOR_SIZE);
                     // 读出分区的超级块，根据魔数判断是否存在文件系统
-                    ide_read(hd, part->start_lba + 1, sb_buf, 1);
+                    bdev_read(part->bdev, part->start_lba + 1, sb_buf, 1);
                     
                     // 现在只支持自己的文件系统
                     // 否则，一律格式化
@@ -399,15 +501,22 @@ void filesys_init() {
     // 挂载默认分区 sdb1
     char *default_part = channels[0].devices[1].prim_parts[0].name; 
     list_traversal(&partition_list, mount_partition, (int)default_part);
+    filesys_start(cur_part);
+}
 
-    // 打开当前分区的根目录
-    open_root_dir(cur_part);
-    // 初始化全局文件表
-    uint32_t fd_idx = 0;
-    while (fd_idx < MAX_FILE_OPEN) {
-        file_table[fd_idx++].fd_inode = NULL;
+/** 在一个单独的分区上启用文件系统：没有文件系统先格式化，再挂载为当前分区。
+ * 不扫描 IDE 硬盘，宿主机上的测试程序用它挂载镜像文件 */
+void filesys_mount(struct partition* part) {
+    struct super_block* sb_buf = (struct super_block*)sys_malloc(SECTOR_SIZE);
+    if (sb_buf == NULL) 
+        PANIC("alloc memory failed!");
+    if (bdev_read(part->bdev, part->start_lba + 1, sb_buf, 1) != 0 || sb_buf->magic != 0x19590318) {
+        printk("  formatting %s...\n", part->name);
+        partition_format(part);
     }
-    
+    sys_free(sb_buf);
+    partition_mount(part);
+    filesys_start(part);
 }
 
 
@@ -8,6 +8,7 @@
 #define BITS_PER_SECTOR 4096     	// 每扇区的位数
 #define SECTOR_SIZE 512          	// 扇区字节大小
 #define BLOCK_SIZE SECTOR_SIZE   	// 块字节大小
+#define WRITEBACK_DELAY_MS 500      // 位图和 inode 修改后最多推迟多久写回硬盘
 
 extern struct list partition_list; 	// 所有分区队列
 
@@ -34,11 +35,16 @@ struct path_search_record {
 };
 
 extern struct partition* cur_part;
+struct file;
 
 void filesys_init(void);
+void filesys_mount(struct partition* part);
 int32_t path_depth_cnt(char* pathname);
 int32_t sys_open(const char* pathname, uint8_t flags);
 int32_t sys_close(int32_t fd);
+int32_t sys_read(int32_t fd, void* buf, uint32_t count);
+struct file* fd2file(int32_t fd);
+void partition_sync(struct partition* part);
 
 #endif
 
@@ -9,6 +9,8 @@
 #include "stdio-kernel.h"
 #include "string.h"
 #include "super_block.h"
+#include "timer.h"
+#include "bcache.h"
 
 /* 用来存储inode位置 */
 struct inode_position {
@@ -23,7 +25,7 @@ static void inode_locate(struct partition* part, uint32_t inode_no, struct inode
     ASSERT(inode_no < 4096);
     uint32_t inode_table_lba = part->sb->inode_table_lba;
     
-    uint32_t inode_size = sizeof(struct inode);
+    uint32_t inode_size = sizeof(struct disk_inode);
     uint32_t off_size = inode_no * inode_size;      // 第inode_no号I结点相对于inode_table_lba的字节偏移量
     uint32_t off_sec  = off_size / 512;             // 第inode_no号I结点相对于inode_table_lba的扇区偏移量
     uint32_t off_size_in_sec = off_size % 512;      // 待查找的inode所在扇区中的起始地址
@@ -34,93 +36,116 @@ static void inode_locate(struct partition* part, uint32_t inode_no, struct inode
     inode_pos->off_size = off_size_in_sec;
 }
 
-/** 将 inode 更新到硬盘中，io_buf 是用于硬盘io的缓冲区 */
-void inode_sync(struct partition* part, struct inode* inode, void* io_buf) {     
-    uint8_t inode_no = inode->i_no;
+/** 将 inode 写入元数据缓存，由分区的回写工作稍后写入硬盘。
+ * 同一扇区上的多个 inode 及对同一 inode 的多次修改都合成一次写 */
+void inode_sync(struct partition* part, struct inode* inode) {     
+    uint32_t inode_no = inode->i_no;
     struct inode_position inode_pos;
     inode_locate(part, inode_no, &inode_pos);  
     ASSERT(inode_pos.sec_lba <= (part->start_lba + part->sec_cnt));
     
-    struct inode pure_inode;
-    memcpy(&pure_inode, inode, sizeof(struct inode));
     // inode 的成员 inode_tag 和 i_open_cnts 只存在于内存中，记录在链表中的位置 和 被多少进程共享
-    // 存入硬盘时置它们为默认值    
-    pure_inode.i_open_cnts = 0;
-    pure_inode.write_deny = false;  // false，保证在硬盘中读出时为可写
-    pure_inode.inode_tag.prev = pure_inode.inode_tag.next = NULL;
+    // 存入硬盘时置它们为默认值，write_deny 为 0 保证在硬盘中读出时为可写
+    struct disk_inode pure_inode;
+    memset(&pure_inode, 0, sizeof(struct disk_inode));
+    pure_inode.i_no = inode->i_no;
+    pure_inode.i_size = inode->i_size;
+    memcpy(pure_inode.i_sectors, inode->i_sectors, sizeof(pure_inode.i_sectors));
     
-    char* inode_buf = (char*)io_buf;
-    // 将待更新的 inode 写入扇区 (读写硬盘以扇区为单位)
-    if (inode_pos.two_sec) {        // inode 跨两个扇区时 
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2); 
-        memcpy((inode_buf + inode_pos.off_size), &pure_inode, sizeof(struct inode)); 
-        ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+    int32_t err;
+    if (inode_pos.two_sec) {        // inode 跨两个扇区时，分成两段写入
+        uint32_t first = SECTOR_SIZE - inode_pos.off_size;
+        err = meta_update(part, inode_pos.sec_lba, inode_pos.off_size, &pure_inode, first);
+        err |= meta_update(part, inode_pos.sec_lba + 1, 0, (uint8_t*)&pure_inode + first, sizeof(struct disk_inode) - first);
     } else {               
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
-        memcpy((inode_buf + inode_pos.off_size), &pure_inode, sizeof(struct inode));
-        ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+        err = meta_update(part, inode_pos.sec_lba, inode_pos.off_size, &pure_inode, sizeof(struct disk_inode));
+    }
+    if (err != 0) {
+        printk("inode_sync: inode %d not written\n", inode_no);
     }
 }
 
-/** 根据 inode号 返回相应的 inode */
-struct inode* inode_open(struct partition* part, uint32_t inode_no) {
-    // 先在 inode 缓冲链表中找 
+/** inode 被修改后调用，写入元数据缓存并安排回写 */
+void inode_mark_dirty(struct partition* part, struct inode* inode) {
+    inode_sync(part, inode);
+}
+
+/** 在 open_inodes 中找 inode_no，找到则打开数加1，调用者至少持有 inode_lock 读锁 */
+static struct inode* inode_lookup(struct partition* part, uint32_t inode_no) {
     struct list_elem* elem = part->open_inodes.head.next;
     struct inode* inode_found;
     while (elem != &part->open_inodes.tail) {
         inode_found = elem2entry(struct inode, inode_tag, elem);
         if (inode_found->i_no == inode_no) {
+            // 读锁下可能有多个线程同时打开同一个 inode
+            enum intr_status old_status = intr_disable();
             inode_found->i_open_cnts++;
+            intr_set_status(old_status);
             return inode_found;
         }
         elem = elem->next;
     }
-    // 链表中没有缓存，从硬盘上读入 并加到链表
+    return NULL;
+}
+
+/** 根据 inode号 返回相应的 inode */
+struct inode* inode_open(struct partition* part, uint32_t inode_no) {
+    // 先在 inode 缓冲链表中找，只读扫描，并发的打开互不阻塞
+    down_read(&part->inode_lock);
+    struct inode* inode_found = inode_lookup(part, inode_no);
+    up_read(&part->inode_lock);
+    if (inode_found != NULL) {
+        return inode_found;
+    }
+    // 链表中没有缓存，从硬盘上读入 并加到链表。读盘时不持锁
     struct inode_position inode_pos;   
     inode_locate(part, inode_no, &inode_pos);
     
-    // 为使 sys_malloc 新创建的 inode 被所有任务共享，需要在内核空间中分配
-    // 因此将 cur_pbc->pgdir 临时置 NULL；这个过程中不可以任务切换（时钟中断） 
-    struct task_struct* cur = running_thread();
-    uint32_t* cur_pagedir_bak = cur->pgdir;
-    enum intr_status old_status = intr_disable();
-    cur->pgdir = NULL;
-    inode_found = (struct inode*)sys_malloc(sizeof(struct inode));
-    // 完成在内核空间分配后 恢复pgdir
-    cur->pgdir = cur_pagedir_bak;
-    intr_set_status(old_status);
+    inode_found = kmalloc(sizeof(struct inode));
 
-    char* inode_buf;
+    // 经元数据缓存读，尚未回写的修改也能读到
+    char* inode_buf = (char*)sys_malloc(SECTOR_SIZE * 2);
+    meta_read(part, inode_pos.sec_lba, inode_buf);
     if (inode_pos.two_sec) {    // 跨扇区时
-        inode_buf = (char*)sys_malloc(1024);
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
-    } else {     
-        inode_buf = (char*)sys_malloc(512);
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+        meta_read(part, inode_pos.sec_lba + 1, inode_buf + SECTOR_SIZE);
     }
-    memcpy(inode_found, inode_buf + inode_pos.off_size, sizeof(struct inode));
-    
-    // 因为一会很可能要用到此inode，故将其插入到队首便于提前检索到 
-    list_push(&part->open_inodes, &inode_found->inode_tag);
-    inode_found->i_open_cnts = 1;
-    
+    struct disk_inode* d_inode = (struct disk_inode*)(inode_buf + inode_pos.off_size);
+    inode_found->i_no = d_inode->i_no;
+    inode_found->i_size = d_inode->i_size;
+    inode_found->i_open_cnts = 0;
+    inode_found->write_deny = false;
+    memcpy(inode_found->i_sectors, d_inode->i_sectors, sizeof(inode_found->i_sectors));
     sys_free(inode_buf);
+    
+    // 读盘期间别的线程可能已经把它加进链表了，拿写锁后再查一次
+    down_write(&part->inode_lock);
+    struct inode* raced = inode_lookup(part, inode_no);
+    if (raced == NULL) {
+        // 因为一会很可能要用到此inode，故将其插入到队首便于提前检索到 
+        list_push(&part->open_inodes, &inode_found->inode_tag);
+        inode_found->i_open_cnts = 1;
+    }
+    up_write(&part->inode_lock);
+
+    if (raced != NULL) {
+        kfree(inode_found);
+        return raced;
+    }
     return inode_found;
 }
 
 /** 关闭或减少 inode 的打开数 */
 void inode_close(struct inode* inode) {
-    enum intr_status old_status = intr_disable();
+    down_write(&cur_part->inode_lock);
     // 若没有进程打开此文件，释放此 inode 
-    if (--inode->i_open_cnts == 0) {    
+    bool last = --inode->i_open_cnts == 0;
+    if (last) {    
         list_remove(&inode->inode_tag);  
-        struct task_struct* cur = running_thread();
-        uint32_t* cur_pagedir_bak = cur->pgdir;
-        cur->pgdir = NULL;
-        sys_free(inode);
-        cur->pgdir = cur_pagedir_bak;
     }
-    intr_set_status(old_status);
+    up_write(&cur_part->inode_lock);
+    if (last) {
+        kfree(inode);
+    }
 }
 
 /** 初始化new_inode */
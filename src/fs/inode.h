@@ -21,8 +21,20 @@ struct inode {
     struct list_elem inode_tag;
 };
 
+/** 硬盘上 inode 表中的 inode，各成员定长，与编译器的指针宽度无关。
+ * 大小和布局与 32 位内核中的 struct inode 相同，已有的镜像照常能用 */
+struct disk_inode {
+    uint32_t i_no;
+    uint32_t i_size;
+    uint32_t i_open_cnts;   // 硬盘上总为 0
+    uint32_t write_deny;    // 硬盘上总为 0
+    uint32_t i_sectors[13];
+    uint32_t reserved[2];   // 内存中 inode_tag 的位置，硬盘上总为 0
+};
+
 struct inode* inode_open(struct partition* part, uint32_t inode_no);
-void inode_sync(struct partition* part, struct inode* inode, void* io_buf);
+void inode_sync(struct partition* part, struct inode* inode);
+void inode_mark_dirty(struct partition* part, struct inode* inode);
 void inode_close(struct inode* inode);
 
 void inode_init(uint32_t inode_no, struct inode* new_inode);
@@ -0,0 +1,112 @@
+#include "readahead.h"
+#include "inode.h"
+#include "memory.h"
+#include "string.h"
+#include "debug.h"
+#include "bcache.h"
+
+/** 为 inode 建立预读状态，读出它的块表，first_blk 是接下来要读的块，从它读起算顺序读。
+ * meta 为 true 时是目录扫描。内存不足或读间接块失败返回 NULL，调用者退回逐块同步读 */
+struct readahead* ra_create(struct partition* part, struct inode* inode, uint32_t first_blk, bool meta) {
+    struct readahead* ra = kmalloc(sizeof(struct readahead));
+    if (ra == NULL) {
+        return NULL;
+    }
+    memset(ra->blocks, 0, sizeof(ra->blocks));
+    memcpy(ra->blocks, inode->i_sectors, 12 * sizeof(uint32_t));
+    if (inode->i_sectors[12] != 0 && meta_read(part, inode->i_sectors[12], ra->blocks + 12) != 0) {
+        kfree(ra);
+        return NULL;
+    }
+    ra->part = part;
+    ra->meta = meta;
+    ra->next = first_blk;
+    ra->ahead = 0;
+    ra->size = 0;
+    for (uint32_t slot = 0; slot < RA_SLOTS; slot++) {
+        ra->slot_blk[slot] = -1;
+    }
+    return ra;
+}
+
+/** 等槽中的预读结束，槽为空或已完成时立即返回 */
+static void ra_slot_drain(struct readahead* ra, uint32_t slot) {
+    if (ra->slot_blk[slot] >= 0) {
+        bio_wait(&ra->slot_bio[slot]);
+    }
+}
+
+/** 对 [from, to) 中已分配的块发起异步预读，同一批提交的相邻块会在请求队列中合并。
+ * 目录块已在元数据缓存中的不再读盘 */
+static void ra_submit(struct readahead* ra, uint32_t from, uint32_t to) {
+    if (to > RA_FILE_BLKS) {
+        to = RA_FILE_BLKS;
+    }
+    for (uint32_t blk = from; blk < to; blk++) {
+        uint32_t slot = blk % RA_SLOTS;
+        if (ra->slot_blk[slot] == (int32_t)blk || ra->blocks[blk] == 0 ||
+            (ra->meta && meta_cached(ra->part, ra->blocks[blk]))) {
+            continue;
+        }
+        ra_slot_drain(ra, slot);
+        ra->slot_blk[slot] = blk;
+        bio_init(&ra->slot_bio[slot], ra->part->bdev, ra->blocks[blk], ra->data + slot * BLOCK_SIZE, 1, false);
+        bio_submit(&ra->slot_bio[slot]);
+    }
+    if (to > ra->ahead) {
+        ra->ahead = to;
+    }
+}
+
+/** 读文件的第 blk 块到 dst(一块大小)，成功返回 0，块未分配或读盘失败返回 -1。
+ * 在元数据缓存中或命中预读的块不必读盘；接着按访问模式调整窗口并预读当前块之后的窗口 */
+int32_t ra_read_block(struct readahead* ra, uint32_t blk, void* dst) {
+    if (blk >= RA_FILE_BLKS || ra->blocks[blk] == 0) {
+        return -1;
+    }
+    uint32_t lba = ra->blocks[blk];
+    uint32_t slot = blk % RA_SLOTS;
+    // 目录块可能在元数据缓存中被改过还没回写，缓存中的版本较新
+    bool cached = meta_peek(ra->part, lba, dst);
+    bool hit = !cached && ra->slot_blk[slot] == (int32_t)blk && bio_wait(&ra->slot_bio[slot]) == 0;
+
+    if (hit || (cached && blk == ra->next && ra->size > 0)) {
+        ra->size = ra->size * 2 > RA_MAX_BLKS ? RA_MAX_BLKS : ra->size * 2;
+    } else if (blk == ra->next) {
+        ra->size = RA_MIN_BLKS;     // 顺序读但没预读到，重新开始
+    } else {
+        ra->size = 0;               // 随机访问，不再预读
+        ra->ahead = blk + 1;
+    }
+    ra->next = blk + 1;
+
+    // 先发预读再读本块：没命中时本块与预读同在队列中，等本块时后面的块已经在路上
+    if (ra->size > 0) {
+        uint32_t from = blk + 1 > ra->ahead ? blk + 1 : ra->ahead;
+        ra_submit(ra, from, blk + 1 + ra->size);
+    }
+    if (cached) {
+        return 0;
+    }
+    if (hit) {
+        memcpy(dst, ra->data + slot * BLOCK_SIZE, BLOCK_SIZE);
+    } else if (bdev_read(ra->part->bdev, lba, dst, 1) != 0) {
+        return -1;
+    }
+    if (ra->meta) {
+        meta_fill(ra->part, lba, dst);
+    }
+    return 0;
+}
+
+/** 等所有预读完成后释放。目录扫描预读到的块即使这次没用上也放进元数据缓存，
+ * 下次查找往往要扫到它们 */
+void ra_destroy(struct readahead* ra) {
+    for (uint32_t slot = 0; slot < RA_SLOTS; slot++) {
+        int32_t blk = ra->slot_blk[slot];
+        if (blk >= 0 && bio_wait(&ra->slot_bio[slot]) == 0 && ra->meta) {
+            meta_fill(ra->part, ra->blocks[blk], ra->data + slot * BLOCK_SIZE);
+        }
+    }
+    kfree(ra);
+}
@@ -0,0 +1,35 @@
+#ifndef __FS_READAHEAD_H
+#define __FS_READAHEAD_H
+#include "stdint.h"
+#include "global.h"
+#include "blkdev.h"
+#include "fs.h"
+
+#define RA_FILE_BLKS    140     // 文件最多的块数：12 个直接块 + 128 个间接块
+#define RA_MIN_BLKS     2       // 刚发现顺序读时的窗口
+#define RA_MAX_BLKS     8       // 窗口上限
+#define RA_SLOTS        (RA_MAX_BLKS * 2)   // 当前块之后还要放下一整个窗口
+
+struct partition;
+struct inode;
+
+/* 一个文件或一次目录扫描的预读状态。
+ * 顺序读时在读到的块之后异步预读一个窗口，命中预读的块窗口翻倍，随机访问时窗口归零。
+ * 目录扫描读到和预读到的块都放进元数据缓存，下次查找不必再读盘 */
+struct readahead {
+    struct partition* part;
+    bool meta;                      // 读的是目录块，经元数据缓存
+    uint32_t blocks[RA_FILE_BLKS];  // 文件各块的扇区地址，0 表示未分配
+    uint32_t next;                  // 顺序读时下一次应读的块号
+    uint32_t ahead;                 // 已发起预读的块号上界(不含)
+    uint32_t size;                  // 当前窗口块数，0 表示不预读
+    int32_t slot_blk[RA_SLOTS];     // 各槽缓存的块号，-1 表示空。块 b 放在 b % RA_SLOTS 槽
+    struct bio slot_bio[RA_SLOTS];
+    uint8_t data[RA_SLOTS * BLOCK_SIZE];
+};
+
+struct readahead* ra_create(struct partition* part, struct inode* inode, uint32_t first_blk, bool meta);
+int32_t ra_read_block(struct readahead* ra, uint32_t blk, void* dst);
+void ra_destroy(struct readahead* ra);
+
+#endif
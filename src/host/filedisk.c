@@ -0,0 +1,92 @@
+#include "filedisk.h"
+#include "memory.h"
+#include "stdio-kernel.h"
+#include "global.h"
+#include "host.h"
+
+/** 在文件偏移 lba*512 处读或写 sec_cnt 个扇区，短读写接着做完。成功返回 0，失败返回 -1 */
+static int32_t filedisk_rw(struct filedisk* fdisk, uint32_t lba, void* buf, uint32_t sec_cnt, bool write) {
+    uint8_t* p = buf;
+    uint64_t pos = (uint64_t)lba * 512;
+    uint32_t left = sec_cnt * 512;
+    while (left > 0) {
+        int64_t bytes = write ? host_pwrite(fdisk->fd, p, left, pos) : host_pread(fdisk->fd, p, left, pos);
+        if (bytes <= 0) {
+            printk("%s: %s failed at lba %d\n", fdisk->bdev.name, write ? "write" : "read", lba);
+            return -1;
+        }
+        p += bytes;
+        pos += bytes;
+        left -= bytes;
+    }
+    fdisk->ops[write]++;
+    fdisk->secs[write] += sec_cnt;
+    return 0;
+}
+
+static int32_t filedisk_read(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+    struct filedisk* fdisk = elem2entry(struct filedisk, bdev, bdev);
+    return filedisk_rw(fdisk, lba, buf, sec_cnt, false);
+}
+
+static int32_t filedisk_write(struct block_device* bdev, uint32_t lba, void* buf, uint32_t sec_cnt) {
+    struct filedisk* fdisk = elem2entry(struct filedisk, bdev, bdev);
+    return filedisk_rw(fdisk, lba, buf, sec_cnt, true);
+}
+
+static int32_t filedisk_flush(struct block_device* bdev) {
+    struct filedisk* fdisk = elem2entry(struct filedisk, bdev, bdev);
+    fdisk->flushes++;
+    return host_fsync(fdisk->fd) == 0 ? 0 : -1;
+}
+
+static uint32_t filedisk_capacity(struct block_device* bdev) {
+    struct filedisk* fdisk = elem2entry(struct filedisk, bdev, bdev);
+    return fdisk->sectors;
+}
+
+// 读写在调用者中同步完成，没有异步提交
+static const struct block_ops filedisk_ops = {
+    .read = filedisk_read,
+    .write = filedisk_write,
+    .flush = filedisk_flush,
+    .capacity = filedisk_capacity,
+    .submit = NULL
+};
+
+/** 打开镜像文件 path 并登记为块设备 name，文件不存在则创建。
+ * sectors 不为 0 时文件不足这么大就补齐；为 0 时按文件现有大小。失败返回 NULL */
+struct filedisk* filedisk_open(const char* name, const char* path, uint32_t sectors) {
+    struct filedisk* fdisk = kmalloc(sizeof(struct filedisk));
+    if (fdisk == NULL) {
+        return NULL;
+    }
+    fdisk->fd = host_open(path);
+    if (fdisk->fd < 0) {
+        printk("%s: cannot open %s\n", name, path);
+        kfree(fdisk);
+        return NULL;
+    }
+    int64_t size = host_file_size(fdisk->fd);
+    if (size >= 0 && sectors == 0) {
+        sectors = size / 512;
+    } else if (size >= 0 && (uint64_t)size < (uint64_t)sectors * 512) {
+        size = host_truncate(fdisk->fd, (uint64_t)sectors * 512) == 0 ? (int64_t)sectors * 512 : -1;
+    }
+    if (size < 0 || sectors == 0) {
+        printk("%s: cannot use %s as a disk\n", name, path);
+        host_close(fdisk->fd);
+        kfree(fdisk);
+        return NULL;
+    }
+    fdisk->sectors = sectors;
+    bdev_register(&fdisk->bdev, name, &filedisk_ops);
+    return fdisk;
+}
+
+/** 注销块设备并关闭镜像文件 */
+void filedisk_close(struct filedisk* fdisk) {
+    list_remove(&fdisk->bdev.bdev_tag);
+    host_close(fdisk->fd);
+    kfree(fdisk);
+}
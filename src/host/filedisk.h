@@ -0,0 +1,19 @@
+#ifndef __HOST_FILEDISK_H
+#define __HOST_FILEDISK_H
+#include "stdint.h"
+#include "blkdev.h"
+
+/* 文件盘：宿主机上用一个镜像文件当硬盘，读写落到 pread/pwrite，冲刷即 fsync */
+struct filedisk {
+    struct block_device bdev;
+    int32_t fd;                 // 镜像文件的描述符
+    uint32_t sectors;
+    uint32_t ops[2];            // 读写次数，下标 0 读 1 写
+    uint32_t secs[2];           // 读写的扇区数
+    uint32_t flushes;
+};
+
+struct filedisk* filedisk_open(const char* name, const char* path, uint32_t sectors);
+void filedisk_close(struct filedisk* fdisk);
+
+#endif
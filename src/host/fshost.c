@@ -0,0 +1,158 @@
+/* 宿主机上的文件系统测试程序：把镜像文件当块设备挂载 src/fs，在根目录下批量创建文件，
+ * 再冷、热两遍按路径打开关闭，打印各阶段的耗时和落到镜像文件上的读写次数。
+ * 用法：fshost <镜像文件> [文件数]。镜像里已有文件系统时直接挂载，要从头测就先删掉镜像。
+ * 硬盘上的 inode 布局与指针宽度无关，这里格式化的镜像和内核的分区可以互相挂载 */
+#include "fs.h"
+#include "file.h"
+#include "dir.h"
+#include "blkdev.h"
+#include "ide.h"
+#include "host.h"
+#include "filedisk.h"
+#include "string.h"
+#include "stdio-kernel.h"
+
+#define FSHOST_SECS     20480   // 新建镜像的扇区数，10MB
+#define FSHOST_FILES    1000    // 默认创建的文件数，根目录 140 块最多放 2940 个目录项
+
+static struct partition part;
+static struct filedisk* fdisk;
+
+/* 一个阶段开始时的时刻和设备计数 */
+struct phase {
+    const char* name;
+    uint64_t start_us;
+    uint32_t ops[2];
+    uint32_t secs[2];
+    uint32_t flushes;
+};
+
+static void phase_begin(struct phase* ph, const char* name) {
+    ph->name = name;
+    ph->ops[0] = fdisk->ops[0];
+    ph->ops[1] = fdisk->ops[1];
+    ph->secs[0] = fdisk->secs[0];
+    ph->secs[1] = fdisk->secs[1];
+    ph->flushes = fdisk->flushes;
+    printk_quiet = true;
+    ph->start_us = host_now_us();
+}
+
+/** 打印本阶段的总耗时、每次操作的平均耗时和设备读写 */
+static void phase_end(struct phase* ph, uint32_t nr_ops) {
+    uint32_t us = host_now_us() - ph->start_us;
+    uint32_t per_op = nr_ops ? us * 100 / nr_ops : 0;     // 百分之一微秒
+    printk_quiet = false;
+    printk("%-12s %6u ops %9u us %6u.%02u us/op  reads %6u (%7u secs)  writes %6u (%7u secs)  flushes %u\n",
+           ph->name, nr_ops, us, per_op / 100, per_op % 100,
+           fdisk->ops[0] - ph->ops[0], fdisk->secs[0] - ph->secs[0],
+           fdisk->ops[1] - ph->ops[1], fdisk->secs[1] - ph->secs[1],
+           fdisk->flushes - ph->flushes);
+}
+
+/** 第 i 个测试文件的路径 /f<i> */
+static void file_path(char* path, uint32_t i) {
+    char digits[10];
+    uint32_t n = 0;
+    do {
+        digits[n++] = '0' + i % 10;
+        i /= 10;
+    } while (i);
+    *path++ = '/';
+    *path++ = 'f';
+    while (n > 0) {
+        *path++ = digits[--n];
+    }
+    *path = 0;
+}
+
+/** 在根目录下创建 nr 个空文件，返回成功的个数 */
+static uint32_t create_files(uint32_t nr) {
+    char path[MAX_FILE_NAME_LEN];
+    uint32_t created = 0;
+    for (uint32_t i = 0; i < nr; i++) {
+        file_path(path, i);
+        int32_t fd = sys_open(path, O_CREAT | O_RDWR);
+        if (fd != -1) {
+            sys_close(fd);
+            created++;
+        }
+    }
+    return created;
+}
+
+/** 按路径打开再关闭 nr 个文件，返回找到的个数 */
+static uint32_t lookup_files(uint32_t nr) {
+    char path[MAX_FILE_NAME_LEN];
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < nr; i++) {
+        file_path(path, i);
+        int32_t fd = sys_open(path, O_RDONLY);
+        if (fd != -1) {
+            sys_close(fd);
+            found++;
+        }
+    }
+    return found;
+}
+
+/** 挂载镜像上的分区，没有文件系统时先格式化 */
+static void mount_image(const char* name) {
+    struct phase ph;
+    phase_begin(&ph, name);
+    filesys_mount(&part);
+    phase_end(&ph, 1);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printk("usage: %s <image> [files]\n", argv[0]);
+        return 1;
+    }
+    uint32_t nr_files = FSHOST_FILES;
+    if (argc > 2) {
+        nr_files = 0;
+        for (char* p = argv[2]; *p >= '0' && *p <= '9'; p++) {
+            nr_files = nr_files * 10 + *p - '0';
+        }
+    }
+
+    blkdev_init();
+    fdisk = filedisk_open("fd0", argv[1], FSHOST_SECS);
+    if (fdisk == NULL) {
+        return 1;
+    }
+    strcpy(part.name, "fd0p1");
+    part.start_lba = 0;
+    part.sec_cnt = bdev_capacity(&fdisk->bdev);
+    part.bdev = &fdisk->bdev;
+
+    struct phase ph;
+    mount_image("mount");
+
+    phase_begin(&ph, "create");
+    uint32_t created = create_files(nr_files);
+    partition_sync(&part);
+    phase_end(&ph, nr_files);
+    if (created != nr_files) {
+        printk("  %u of %u files already exist or could not be created\n", nr_files - created, nr_files);
+    }
+
+    // 重新挂载，丢掉元数据缓存，下面第一遍查找从镜像读
+    mount_image("remount");
+
+    phase_begin(&ph, "lookup-cold");
+    uint32_t found = lookup_files(nr_files);
+    phase_end(&ph, nr_files);
+
+    phase_begin(&ph, "lookup-warm");
+    lookup_files(nr_files);
+    phase_end(&ph, nr_files);
+    if (found != nr_files) {
+        printk("  %u of %u files not found\n", nr_files - found, nr_files);
+    }
+
+    partition_sync(&part);
+    filedisk_close(fdisk);
+    return found == nr_files ? 0 : 1;
+}
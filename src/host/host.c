@@ -0,0 +1,184 @@
+/* 宿主机上的内核服务：把 src/fs 和块设备层用到的内核接口映射到 libc。
+ * 测试程序只有一个线程，块设备同步完成读写，所以锁和等待队列都不需要真的阻塞 */
+#include "thread.h"
+#include "sync.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "workqueue.h"
+#include "timer.h"
+#include "uaccess.h"
+#include "debug.h"
+#include "stdio-kernel.h"
+#include "ide.h"
+#include "string.h"
+#include "host.h"
+
+bool printk_quiet;
+
+// fs.c 的 IDE 分区扫描引用它们，宿主机上没有 IDE 硬盘
+uint8_t channel_cnt;
+struct ide_channel channels[2];
+struct list partition_list;
+
+static struct task_struct host_task;
+
+/** 宿主机进程就是唯一的线程，它的 leader 是自己 */
+struct task_struct* running_thread(void) {
+    if (host_task.leader == NULL) {
+        host_task.leader = &host_task;
+        for (uint32_t fd = 3; fd < MAX_FILES_OPEN_PER_PROC; fd++) {
+            host_task.fd_table[fd] = -1;
+        }
+    }
+    return &host_task;
+}
+
+void printk(const char* format, ...) {
+    if (printk_quiet) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    host_vprintf(format, args);
+    va_end(args);
+}
+
+void panic_spin(char* filename, int line, const char* func, const char* condition) {
+    printk_quiet = false;
+    printk("\n!!!!! error !!!!!\nfilename:%s\nline:%d\nfunction:%s\ncondition:%s\n", filename, line, func, condition);
+    host_abort();
+}
+
+// ---------------- 内存 ----------------
+// 内核的分配函数都返回清零的内存
+
+void* sys_malloc(uint32_t size) {
+    return host_calloc(size);
+}
+
+void sys_free(void* ptr) {
+    host_free(ptr);
+}
+
+void* kmalloc(uint32_t size) {
+    return host_calloc(size);
+}
+
+void kfree(void* ptr) {
+    host_free(ptr);
+}
+
+void* get_pages(uint32_t pg_cnt, enum pool_flags flag UNUSED) {
+    return host_page_alloc(pg_cnt * PG_SIZE);
+}
+
+void free_pages(void* vaddr, uint32_t pg_cnt UNUSED, enum pool_flags flag UNUSED) {
+    host_free(vaddr);
+}
+
+// ---------------- 中断与同步 ----------------
+// 没有中断也没有别的线程：开关中断是空操作，锁只记下持有者用来检查加解锁是否配对
+
+enum intr_status intr_disable(void) {
+    return INTR_ON;
+}
+
+enum intr_status intr_set_status(enum intr_status status UNUSED) {
+    return INTR_ON;
+}
+
+void mutex_init(struct mutex_t* pmutex) {
+    pmutex->holder = NULL;
+    pmutex->holder_repeat_nr = 0;
+}
+
+/** 与内核一样允许持有者重复加锁 */
+void mutex_lock(struct mutex_t* pmutex) {
+    ASSERT(pmutex->holder == NULL || pmutex->holder == running_thread());
+    pmutex->holder = running_thread();
+    pmutex->holder_repeat_nr++;
+}
+
+void mutex_unlock(struct mutex_t* pmutex) {
+    ASSERT(pmutex->holder == running_thread() && pmutex->holder_repeat_nr > 0);
+    if (--pmutex->holder_repeat_nr == 0) {
+        pmutex->holder = NULL;
+    }
+}
+
+void rwsem_init(struct rw_semaphore* rwsem) {
+    rwsem->readers = 0;
+    rwsem->writer = false;
+}
+
+void down_read(struct rw_semaphore* rwsem) {
+    ASSERT(!rwsem->writer);
+    rwsem->readers++;
+}
+
+void up_read(struct rw_semaphore* rwsem) {
+    rwsem->readers--;
+}
+
+void down_write(struct rw_semaphore* rwsem) {
+    ASSERT(!rwsem->writer && rwsem->readers == 0);
+    rwsem->writer = true;
+}
+
+void up_write(struct rw_semaphore* rwsem) {
+    rwsem->writer = false;
+}
+
+void wait_queue_init(struct wait_queue* wq) {
+    list_init(&wq->waiters);
+}
+
+/** 只有一个线程，没人能满足等待的条件，睡下去就再也醒不来 */
+bool wait_queue_sleep(struct wait_queue* wq UNUSED, uint32_t timeout_ticks UNUSED) {
+    PANIC("wait_queue_sleep: no other thread on host");
+    return false;
+}
+
+void wake_up_all(struct wait_queue* wq UNUSED) {
+}
+
+// ---------------- 延迟工作 ----------------
+// 没有时钟中断和 kworker：排队只记下 pending，等 flush 时在调用者中执行
+
+uint32_t ms_to_ticks(uint32_t m_seconds) {
+    return DIV_ROUND_UP(m_seconds, 10);
+}
+
+void delayed_work_init(struct delayed_work* dwork, work_func* func, void* arg) {
+    dwork->work.func = func;
+    dwork->work.arg = arg;
+    dwork->work.pending = false;
+    dwork->timer_pending = false;
+}
+
+bool queue_delayed_work(struct delayed_work* dwork, uint32_t delay UNUSED) {
+    if (dwork->work.pending) {
+        return false;
+    }
+    dwork->work.pending = true;
+    return true;
+}
+
+void flush_delayed_work(struct delayed_work* dwork) {
+    if (dwork->work.pending) {
+        dwork->work.pending = false;
+        dwork->work.func(dwork->work.arg);
+    }
+}
+
+// ---------------- 用户内存 ----------------
+// 宿主机上不分用户和内核空间
+
+bool access_ok(const void* uaddr UNUSED, uint32_t size UNUSED, bool write UNUSED) {
+    return true;
+}
+
+uint32_t copy_to_user(void* to, const void* from, uint32_t n) {
+    memcpy(to, from, n);
+    return 0;
+}
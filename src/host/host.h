@@ -0,0 +1,28 @@
+#ifndef __HOST_HOST_H
+#define __HOST_HOST_H
+#include "stdint.h"
+#include "global.h"
+#include <stdarg.h>
+
+/* 内核头文件里的 pid_t、sleep 等名字与 libc 冲突，两边的头文件不能在一个文件里同时包含。
+ * hostlib.c 只包含系统头文件，把测试程序用到的 libc 功能包成下面这些函数 */
+
+extern bool printk_quiet;       // 置位后 printk 不输出，计时阶段用
+
+void* host_calloc(uint32_t size);
+void* host_page_alloc(uint32_t size);
+void  host_free(void* ptr);
+void  host_vprintf(const char* format, va_list args);
+void  host_abort(void);
+
+int32_t host_open(const char* path);
+int64_t host_file_size(int32_t fd);
+int32_t host_truncate(int32_t fd, uint64_t size);
+int64_t host_pread(int32_t fd, void* buf, uint32_t len, uint64_t pos);
+int64_t host_pwrite(int32_t fd, const void* buf, uint32_t len, uint64_t pos);
+int32_t host_fsync(int32_t fd);
+void    host_close(int32_t fd);
+
+uint64_t host_now_us(void);
+
+#endif
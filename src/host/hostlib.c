@@ -0,0 +1,73 @@
+#include "host.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+/** 清零的内存 */
+void* host_calloc(uint32_t size) {
+    return calloc(1, size);
+}
+
+/** 按页对齐、清零的内存，size 为页的整数倍 */
+void* host_page_alloc(uint32_t size) {
+    void* ptr = aligned_alloc(PG_SIZE, size);
+    if (ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void host_free(void* ptr) {
+    free(ptr);
+}
+
+void host_vprintf(const char* format, va_list args) {
+    vprintf(format, args);
+}
+
+void host_abort(void) {
+    fflush(stdout);
+    abort();
+}
+
+/** 以读写方式打开 path，不存在则创建。失败返回 -1 */
+int32_t host_open(const char* path) {
+    return open(path, O_RDWR | O_CREAT, 0644);
+}
+
+/** 文件的字节数，失败返回 -1 */
+int64_t host_file_size(int32_t fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 ? st.st_size : -1;
+}
+
+int32_t host_truncate(int32_t fd, uint64_t size) {
+    return ftruncate(fd, size);
+}
+
+int64_t host_pread(int32_t fd, void* buf, uint32_t len, uint64_t pos) {
+    return pread(fd, buf, len, pos);
+}
+
+int64_t host_pwrite(int32_t fd, const void* buf, uint32_t len, uint64_t pos) {
+    return pwrite(fd, buf, len, pos);
+}
+
+int32_t host_fsync(int32_t fd) {
+    return fsync(fd);
+}
+
+void host_close(int32_t fd) {
+    close(fd);
+}
+
+/** 单调时钟，微秒 */
+uint64_t host_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,81 @@
+#include "fpu.h"
+#include "cpu.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "print.h"
+#include "debug.h"
+
+/* FPU 寄存器里现在装的是谁的上下文，NULL 表示没人用过或其主人已死 */
+static struct task_struct* fpu_owner;
+static bool has_fxsr;       // 是否支持 fxsave/fxrstor
+
+static void fpu_save(struct task_struct* pthread) {
+    if (has_fxsr) {
+        asm volatile ("fxsave %0" : "=m" (pthread->fpu_state.fxsave));
+    } else {
+        asm volatile ("fnsave %0; fwait" : "=m" (pthread->fpu_state.fnsave));
+    }
+}
+
+static void fpu_restore(struct task_struct* pthread) {
+    if (has_fxsr) {
+        asm volatile ("fxrstor %0" : : "m" (pthread->fpu_state.fxsave));
+    } else {
+        asm volatile ("frstor %0" : : "m" (pthread->fpu_state.fnsave));
+    }
+}
+
+/** #NM 处理函数：当前线程第一次碰 FPU，把上一个主人的状态存起来，换上自己的 */
+static void intr_nm_handler(__attribute__((unused)) uint8_t vec_no) {
+    struct task_struct* cur = running_thread();
+    clts();
+    if (fpu_owner == cur) {
+        return;
+    }
+    if (fpu_owner != NULL) {
+        fpu_save(fpu_owner);
+    }
+    if (cur->fpu_used) {
+        fpu_restore(cur);
+    } else {
+        asm volatile ("fninit");
+        cur->fpu_used = true;
+    }
+    fpu_owner = cur;
+}
+
+/** 调度时调用：只有 next 正是 FPU 的主人才放行浮点指令，否则等它真用到时再切换 */
+void fpu_switch(struct task_struct* prev, struct task_struct* next) {
+    if (prev->status == TASK_DIED && fpu_owner == prev) {
+        fpu_owner = NULL;   // 死掉的线程的状态不必再保存
+    }
+    if (next == fpu_owner) {
+        clts();
+    } else {
+        stts();
+    }
+}
+
+/** 开启 FPU，支持的话一并开启 SSE，并注册 #NM 处理函数 */
+void fpu_init(void) {
+    put_str("   fpu_init start...\n");
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    ASSERT(edx & CPUID_EDX_FPU);
+
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE);
+    has_fxsr = edx & CPUID_EDX_FXSR;
+    if (has_fxsr) {
+        uint32_t cr4 = read_cr4() | CR4_OSFXSR;
+        if (edx & CPUID_EDX_SSE) {
+            cr4 |= CR4_OSXMMEXCPT;
+        }
+        write_cr4(cr4);
+    }
+    asm volatile ("fninit");
+
+    fpu_owner = NULL;
+    register_handler(0x07, intr_nm_handler);
+    stts();                 // 从此谁先用 FPU 谁触发 #NM
+    put_str("   fpu_init done!\n");
+}
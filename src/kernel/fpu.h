@@ -0,0 +1,16 @@
+#ifndef __KERNEL_FPU_H
+#define __KERNEL_FPU_H
+#include "stdint.h"
+
+struct task_struct;
+
+/* 线程的浮点上下文。支持 fxsave 时用 512 字节的格式(含 SSE 寄存器)，否则用 fnsave 的 108 字节 */
+union fpu_state {
+    uint8_t fxsave[512];
+    uint8_t fnsave[108];
+} __attribute__ ((aligned (16)));
+
+void fpu_init(void);
+void fpu_switch(struct task_struct* prev, struct task_struct* next);
+
+#endif
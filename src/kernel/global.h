@@ -37,9 +37,16 @@
 #define SELECTOR_U_DATA     ((6 << 3) + (TI_GDT << 2) + RPL3)
 #define SELECTOR_U_STACK    SELECTOR_U_DATA
 
+/* sysenter/sysexit 要求 内核代码、内核栈、用户代码、用户栈 四个描述符在 gdt 中连续，
+ * 放在第 7～10 项，段属性与上面对应的段相同 */
+#define SELECTOR_SYSENTER_CS    ((7 << 3) + (TI_GDT << 2) + RPL0)
+#define SELECTOR_SYSEXIT_DS     ((10 << 3) + (TI_GDT << 2) + RPL3)
+
 #define GDT_ATTR_HIGH           ((DESC_G_4K << 7) + (DESC_D_32 << 6) + (DESC_L << 5) + (DESC_AVL << 4))
 #define GDT_CODE_ATTR_LOW_DPL3  ((DESC_P << 7) + (DESC_DPL_3 << 5) + (DESC_S_CODE << 4) + DESC_TYPE_CODE)
 #define GDT_DATA_ATTR_LOW_DPL3  ((DESC_P << 7) + (DESC_DPL_3 << 5) + (DESC_S_DATA << 4) + DESC_TYPE_DATA)
+#define GDT_CODE_ATTR_LOW_DPL0  ((DESC_P << 7) + (DESC_DPL_0 << 5) + (DESC_S_CODE << 4) + DESC_TYPE_CODE)
+#define GDT_DATA_ATTR_LOW_DPL0  ((DESC_P << 7) + (DESC_DPL_0 << 5) + (DESC_S_DATA << 4) + DESC_TYPE_DATA)
 
 //---------------  TSS描述符  ------------
 #define TSS_DESC_D      0
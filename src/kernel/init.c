@@ -9,7 +9,12 @@
 #include "tss.h"
 #include "syscall-init.h"
 #include "ide.h"
+#include "raid.h"
+#include "blkdev.h"
+#include "ramdisk.h"
 #include "fs.h"
+#include "fpu.h"
+#include "workqueue.h"
 
 /*负责初始化所有模块 */
 void init_all() {
@@ -18,11 +23,16 @@ void init_all() {
     timer_init();    // 初始化PIT
     mem_init();
     thread_init();
+    fpu_init();
+    workqueue_init();
     console_init();
     keyboard_init();
     tss_init();
     syscall_init();
+    blkdev_init();
     ide_init();
+    raid_init();
+    ramdisk_init();
     filesys_init();
 
     put_str("\nAll Initialization Complete!\n\n");  
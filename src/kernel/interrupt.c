@@ -3,6 +3,9 @@
 #include "global.h"
 #include "io.h"
 #include "print.h"
+#include "thread.h"
+#include "uaccess.h"
+#include "exec.h"
 
 #define PIC_M_CTRL 0x20         // 这里用的可编程中断控制器是8259A,主片的控制端口是0x20
 #define PIC_M_DATA 0x21         // 主片的数据端口是0x21
@@ -68,6 +71,28 @@ static void general_intr_handler(uint8_t vec_num) {
     while(1);
 }
 
+/** 缺页异常。用户地址先看是否属于按需加载的区间；内核访问用户内存的指令登记在异常修复表中，
+ * 这类缺页跳到修复代码返回错误；其余情况仍按一般异常处理。
+ * kernel.S 压入的向量号就是 intr_stack 的第一项，取其地址即得中断栈 */
+static void intr_page_fault(uint32_t vec_no) {
+    struct intr_stack* frame = (struct intr_stack*)&vec_no;
+    uint32_t vaddr;
+    asm ("movl %%cr2, %0" : "=r" (vaddr));  // 开中断前取出，别的线程缺页会改写 cr2
+    // 装入要读硬盘，须开中断等待；缺页前就关着中断的地方不能睡眠，不处理
+    if (vaddr < KERNEL_SPACE && (frame->eflags & EFLAGS_IF) && running_thread()->pgdir != NULL) {
+        intr_enable();
+        bool loaded = vma_fault(vaddr);
+        intr_disable();
+        if (loaded) {
+            return;
+        }
+    }
+    if ((frame->cs & 3) == 0 && fixup_exception(frame)) {
+        return;
+    }
+    general_intr_handler(vec_no);
+}
+
 /* 完成一般中断处理函数注册及异常名称注册 */
 static void exception_init(void) {
     int i;
@@ -92,6 +117,7 @@ static void exception_init(void) {
     intr_name[12] = "#SS Stack Fault Exception";
     intr_name[13] = "#GP General Protection Exception";
     intr_name[14] = "#PF Page-Fault Exception";
+    idt_table[14] = intr_page_fault;
     // intr_name[15] intel 保留项
     intr_name[16] = "#MF x87 FPU Floating-Point Error";
     intr_name[17] = "#AC Alignment Check Exception";
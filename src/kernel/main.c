@@ -3,12 +3,57 @@
 #include "process.h"
 #include "syscall.h"
 #include "stdio.h"
+#include "thread.h"
+#include "sync.h"
+#include "cpu.h"
+#include "timer.h"
+#include "stdio-kernel.h"
+#include "blkdev.h"
+#include "ide.h"
+#include "raid.h"
+#include "iostat.h"
+#include "memory.h"
+#include "debug.h"
+
+#define PINGPONG_ROUNDS 10000
+#define RAID_READERS    4       // 并发读的线程数
+#define RAID_READ_SECS  4096    // 每个线程读的扇区数，2MB
+#define RAID_IO_SECS    128     // 每次读 64KB
+#define PI_LOW_PRIO     2
+#define PI_MID_PRIO     10
+#define PI_HIGH_PRIO    30
+#define PI_SPIN_TICKS   50      // 中优先级线程空转的嘀嗒数，远长于低优先级线程剩下的临界区
+#define PI_HOLD_TICKS   5       // 高优先级线程等锁后低优先级线程还要持锁的嘀嗒数，超过它自己的时间片
+#define LOCK_THREADS    4       // 争抢同一把锁的线程数
+#define LOCK_ROUNDS     2000    // 每个线程加锁的次数
+#define LOCK_HOLD_LOOPS 200     // 临界区的空循环次数，相当于几百条指令
+#define LOCK_YIELD_EVERY 16     // 每隔这么多次持锁让出 cpu，制造争用
+#define FANOUT_THREADS  32      // 扇出测试启动的线程数
+#define FANOUT_LOOPS    2000000 // 每个线程的计算量
+#define PIO_BENCH_SECS  4096    // 每种方式顺序读的扇区数，2MB
+#define PIO_BENCH_IO_SECS 1024  // 每次 bdev_read 的扇区数，够合并成一条 LBA48 命令
   
 void u_prog_a(void); 
+#ifdef BENCH
+void switch_bench(void);
+void raid_bench(void);
+void pi_test(void);
+void lock_bench(void);
+void fanout_bench(void);
+void pio_bench(void);
+#endif
 
 int main(void) {
   
     init_all();
+#ifdef BENCH
+    switch_bench();
+    fanout_bench();
+    pi_test();
+    lock_bench();
+    pio_bench();
+    raid_bench();
+#endif
     
     process_execute(u_prog_a, "u_prog_a");
   
@@ -22,3 +67,294 @@ void u_prog_a(void) {
  
     while(1);
 }
+
+#ifdef BENCH
+/* 基准测试只在 make BENCH=1 时编入，正常开机不跑 */
+
+/* 上下文切换 ping-pong 测试：两个内核线程用信号量轮流唤醒对方 */
+static struct semaphore ping, pong, bench_done;
+
+static void k_ping(__attribute__((unused)) void* arg) {
+    for (int i = 0; i < PINGPONG_ROUNDS; i++) {
+        sema_v(&pong);
+        sema_p(&ping);
+    }
+    sema_v(&bench_done);
+}
+
+static void k_pong(__attribute__((unused)) void* arg) {
+    for (int i = 0; i < PINGPONG_ROUNDS; i++) {
+        sema_p(&pong);
+        sema_v(&ping);
+    }
+}
+
+/** 打印每次往返的平均周期数及期间实际写 cr3 的次数 */
+void switch_bench(void) {
+    sema_init(&ping, 0);
+    sema_init(&pong, 0);
+    sema_init(&bench_done, 0);
+    uint32_t cr3_loads = this_rq()->nr_cr3_loads;
+    uint64_t start = rdtsc();
+    thread_start("k_ping", 31, k_ping, NULL);
+    thread_start("k_pong", 31, k_pong, NULL);
+    sema_p(&bench_done);
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    printk("ping-pong: %d rounds, %d cycles/round (%d us total), %d cr3 loads\n",
+        PINGPONG_ROUNDS, cycles / PINGPONG_ROUNDS, tsc_to_us(cycles),
+        this_rq()->nr_cr3_loads - cr3_loads);
+}
+
+/* 并发读吞吐测试：同样的读分别落在单块硬盘和跨通道的 md0 上 */
+struct raid_bench_arg {
+    struct block_device* bdev;
+    uint32_t start;
+};
+
+static struct semaphore readers_done;
+
+static void k_reader(void* arg) {
+    struct raid_bench_arg* rarg = arg;
+    void* buf = sys_malloc(RAID_IO_SECS * 512);
+    for (uint32_t off = 0; off < RAID_READ_SECS; off += RAID_IO_SECS) {
+        bdev_read(rarg->bdev, rarg->start + off, buf, RAID_IO_SECS);
+    }
+    sys_free(buf);
+    sema_v(&readers_done);
+}
+
+/** RAID_READERS 个线程各读不同的一段，返回总吞吐 KB/s */
+static uint32_t parallel_read(struct block_device* bdev) {
+    struct raid_bench_arg args[RAID_READERS];
+    sema_init(&readers_done, 0);
+    uint64_t start = rdtsc();
+    for (int i = 0; i < RAID_READERS; i++) {
+        args[i].bdev = bdev;
+        args[i].start = i * RAID_READ_SECS;
+        thread_start("k_reader", 31, k_reader, &args[i]);
+    }
+    for (int i = 0; i < RAID_READERS; i++) {
+        sema_p(&readers_done);
+    }
+    uint32_t ms = tsc_to_us(rdtsc() - start) / 1000;
+    uint32_t kbytes = RAID_READERS * RAID_READ_SECS / 2;
+    return kbytes * 1000 / (ms ? ms : 1);
+}
+
+/** 比较单盘与 md0 的并发读吞吐，没有 md0 时跳过 */
+void raid_bench(void) {
+    if (raid_cnt == 0) {
+        return;
+    }
+    struct raid_dev* md = &raid_devs[0];
+    uint32_t single = parallel_read(md->members[0]);
+    uint32_t striped = parallel_read(&md->bdev);
+    printk("raid read: %d readers x %dKB, %s %dKB/s, %s %dKB/s\n",
+        RAID_READERS, RAID_READ_SECS / 2, md->members[0]->name, single, md->bdev.name, striped);
+    sys_disk_stats();   // 成员盘的服务时间和排队延迟
+}
+/* 优先级反转测试：低优先级线程持锁，中优先级线程空转，高优先级线程等锁。
+ * 低优先级线程剩下的临界区比它自己的时间片长，没有优先级继承时中途被抢占，
+ * 高优先级线程至少要多等中优先级线程的一个时间片 */
+static struct mutex_t pi_lock;
+static struct semaphore pi_locked, pi_done;
+static struct task_struct* pi_high;
+static uint32_t pi_wait;            // 高优先级线程从睡在锁上到拿到锁的嘀嗒数
+static uint8_t pi_boosted, pi_restored;
+
+/** 空转 n 个嘀嗒 */
+static void spin_ticks(uint32_t n) {
+    uint32_t end = *(volatile uint32_t*)&ticks + n;
+    while ((int32_t)(*(volatile uint32_t*)&ticks - end) < 0);
+}
+
+static void k_pi_low(__attribute__((unused)) void* arg) {
+    mutex_lock(&pi_lock);
+    sema_v(&pi_locked);
+    while (pi_high == NULL || pi_high->blocked_on != &pi_lock) {
+        thread_yield();
+    }
+    pi_boosted = running_thread()->priority;    // 高优先级线程已睡在锁上
+    spin_ticks(PI_HOLD_TICKS);
+    mutex_unlock(&pi_lock);
+    pi_restored = running_thread()->priority;
+    sema_v(&pi_done);
+}
+
+static void k_pi_mid(__attribute__((unused)) void* arg) {
+    spin_ticks(PI_SPIN_TICKS);
+    sema_v(&pi_done);
+}
+
+static void k_pi_high(__attribute__((unused)) void* arg) {
+    uint32_t start = ticks;     // 低优先级线程持着锁，马上就会睡下
+    mutex_lock(&pi_lock);
+    pi_wait = ticks - start;
+    mutex_unlock(&pi_lock);
+    sema_v(&pi_done);
+}
+
+/** 检查持锁的低优先级线程被抬到等待者的优先级、释放后恢复，
+ * 且高优先级线程等锁的时间短于中优先级线程的一个时间片，即没有被中优先级线程插队 */
+void pi_test(void) {
+    mutex_init(&pi_lock);
+    sema_init(&pi_locked, 0);
+    sema_init(&pi_done, 0);
+    pi_high = NULL;
+    thread_start("pi_low", PI_LOW_PRIO, k_pi_low, NULL);
+    sema_p(&pi_locked);
+    thread_start("pi_mid", PI_MID_PRIO, k_pi_mid, NULL);
+    pi_high = thread_start("pi_high", PI_HIGH_PRIO, k_pi_high, NULL);
+    for (int i = 0; i < 3; i++) {
+        sema_p(&pi_done);
+    }
+    printk("priority inheritance: low boosted to %d, restored to %d, high waited %d ticks\n",
+        pi_boosted, pi_restored, pi_wait);
+    ASSERT(pi_boosted == PI_HIGH_PRIO);
+    ASSERT(pi_restored == PI_LOW_PRIO);
+    ASSERT(pi_wait < PI_MID_PRIO);
+}
+
+/* 加锁延迟测试：多个线程争抢同一把锁，记录 mutex_lock 从调用到返回的周期数 */
+static struct mutex_t bench_lock;
+static struct semaphore lockers_done;
+static uint64_t lock_wait_tsc;      // 所有线程加锁耗时之和，只在持锁时累加
+static uint32_t lock_wait_max;
+static volatile uint32_t lock_counter;
+
+/** 加锁一次并记录耗时，持锁做 LOCK_HOLD_LOOPS 次空循环，yield 为真时持锁让出 cpu */
+static void lock_round(bool yield) {
+    uint64_t start = rdtsc();
+    mutex_lock(&bench_lock);
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    lock_wait_tsc += cycles;
+    if (cycles > lock_wait_max) {
+        lock_wait_max = cycles;
+    }
+    for (int i = 0; i < LOCK_HOLD_LOOPS; i++) {
+        lock_counter++;
+    }
+    if (yield) {
+        thread_yield();
+    }
+    mutex_unlock(&bench_lock);
+}
+
+static void k_locker(__attribute__((unused)) void* arg) {
+    for (int i = 1; i <= LOCK_ROUNDS; i++) {
+        lock_round(i % LOCK_YIELD_EVERY == 0);
+    }
+    sema_v(&lockers_done);
+}
+
+/** 打印一组加锁的平均、最大周期数和锁上的争用计数 */
+static void lock_report(const char* title, uint32_t rounds) {
+    // 32 位内核没有 64 位除法，累计值超出 32 位时改用移位近似
+    uint64_t total = lock_wait_tsc;
+    uint32_t n = rounds;
+    while (total >> 32) {
+        total >>= 1;
+        n = (n >> 1) | 1;
+    }
+    printk("mutex %s: %d acquires, avg %d cycles, max %d cycles (%d us), contended %d, spin acquired %d\n",
+        title, rounds, (uint32_t)total / n, lock_wait_max, tsc_to_us(lock_wait_max),
+        bench_lock.nr_contended, bench_lock.nr_spin_acquire);
+}
+
+/** 先单线程测无争用的快速路径，再让 LOCK_THREADS 个线程争抢，比较加锁延迟 */
+void lock_bench(void) {
+    mutex_init(&bench_lock);
+    lock_wait_tsc = 0;
+    lock_wait_max = 0;
+    for (int i = 0; i < LOCK_ROUNDS; i++) {
+        lock_round(false);
+    }
+    lock_report("uncontended", LOCK_ROUNDS);
+
+    mutex_init(&bench_lock);
+    lock_wait_tsc = 0;
+    lock_wait_max = 0;
+    sema_init(&lockers_done, 0);
+    for (int i = 0; i < LOCK_THREADS; i++) {
+        thread_start("k_locker", 31, k_locker, NULL);
+    }
+    for (int i = 0; i < LOCK_THREADS; i++) {
+        sema_p(&lockers_done);
+    }
+    lock_report("contended", LOCK_THREADS * LOCK_ROUNDS);
+}
+
+/* 扇出测试：一次启动大量 CPU 密集的内核线程，统计全部完成的时间和各 cpu 的利用率、窃取次数 */
+static struct semaphore fanout_done;
+
+static void k_fanout(__attribute__((unused)) void* arg) {
+    volatile uint32_t x = 0;
+    for (uint32_t i = 0; i < FANOUT_LOOPS; i++) {
+        x += i;
+    }
+    sema_v(&fanout_done);
+}
+
+/** 打印完成时间，以及期间每个 cpu 的忙嘀嗒占比和从别的 cpu 窃取的线程数 */
+void fanout_bench(void) {
+    uint32_t busy[NR_CPUS], idle[NR_CPUS], steals[NR_CPUS];
+    for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+        busy[cpu] = run_queues[cpu].busy_ticks;
+        idle[cpu] = run_queues[cpu].idle_ticks;
+        steals[cpu] = run_queues[cpu].nr_steals;
+    }
+    sema_init(&fanout_done, 0);
+    uint64_t start = rdtsc();
+    for (int i = 0; i < FANOUT_THREADS; i++) {
+        thread_start("k_fanout", 8, k_fanout, NULL);
+    }
+    for (int i = 0; i < FANOUT_THREADS; i++) {
+        sema_p(&fanout_done);
+    }
+    printk("fan-out: %d threads x %d loops, %d us\n", FANOUT_THREADS, FANOUT_LOOPS, tsc_to_us(rdtsc() - start));
+    for (int cpu = 0; cpu < NR_CPUS; cpu++) {
+        uint32_t b = run_queues[cpu].busy_ticks - busy[cpu];
+        uint32_t total = b + run_queues[cpu].idle_ticks - idle[cpu];
+        printk("  cpu%d: busy %d/%d ticks (%d%%), %d steals\n",
+            cpu, b, total, total ? b * 100 / total : 0, run_queues[cpu].nr_steals - steals[cpu]);
+    }
+}
+
+/** 以每次 io_secs 个扇区顺序读 hd 的前 PIO_BENCH_SECS 个扇区，返回每秒扇区数 */
+static uint32_t pio_read_rate(struct disk* hd, void* buf, uint32_t io_secs) {
+    uint64_t start = rdtsc();
+    for (uint32_t lba = 0; lba < PIO_BENCH_SECS; lba += io_secs) {
+        bdev_read(&hd->bdev, lba, buf, io_secs);
+    }
+    uint32_t ms = tsc_to_us(rdtsc() - start) / 1000;
+    return PIO_BENCH_SECS * 1000 / (ms ? ms : 1);
+}
+
+/** 在 sda 上比较 PIO 顺序读的扇区/秒：每扇区一条命令、READ SECTORS、READ MULTIPLE、READ MULTIPLE 加 LBA48 合并。
+ * 测试期间关掉 DMA 并临时改每块扇区数和单条命令的扇区上限，测完恢复 */
+void pio_bench(void) {
+    struct disk* hd = &channels[0].devices[0];
+    void* buf = get_pages(PIO_BENCH_IO_SECS * 512 / PG_SIZE, PF_KERNEL);
+    if (buf == NULL) {
+        return;
+    }
+    bool dma = hd->dma;
+    uint8_t multi_secs = hd->multi_secs;
+    uint32_t max_secs = hd->max_secs;
+    hd->dma = false;
+
+    hd->multi_secs = 1;
+    uint32_t single = pio_read_rate(hd, buf, 1);
+    hd->max_secs = 256;                 // 一条 LBA28 命令的上限，不走 LBA48
+    uint32_t sectors = pio_read_rate(hd, buf, PIO_BENCH_IO_SECS);
+    hd->multi_secs = multi_secs;
+    uint32_t multiple = pio_read_rate(hd, buf, PIO_BENCH_IO_SECS);
+    hd->max_secs = max_secs;
+    uint32_t lba48 = hd->lba48 ? pio_read_rate(hd, buf, PIO_BENCH_IO_SECS) : 0;
+
+    hd->dma = dma;
+    free_pages(buf, PIO_BENCH_IO_SECS * 512 / PG_SIZE, PF_KERNEL);
+    printk("pio read %s: single %d, sectors %d, multiple(%d) %d, lba48 %d sectors/s\n",
+        hd->name, single, sectors, multi_secs, multiple, lba48);
+}
+#endif
@@ -54,7 +54,8 @@ static void* vaddr_get(enum pool_flags pf, uint32_t pg_cnt) {
         vaddr_start = kernel_vaddr.vaddr_start + bit_idx_start * PG_SIZE;
     } else {
         // 用户内存池 
-        struct task_struct* cur = running_thread();
+        // 进程内的线程共用 leader 的虚拟地址池
+        struct task_struct* cur = running_thread()->leader;
         bit_idx_start = bitmap_scan(&cur->userprog_vaddr.vaddr_bitmap, pg_cnt);
         if (bit_idx_start == -1) {
             return NULL;
@@ -78,7 +79,7 @@ static void vaddr_remove(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt) {
             bitmap_set(&kernel_vaddr.vaddr_bitmap, bit_idx_start + cnt++, 0);
         }
     } else {  // 用户虚拟内存池
-        struct task_struct* cur_thread = running_thread();
+        struct task_struct* cur_thread = running_thread()->leader;
         bit_idx_start = (vaddr - cur_thread->userprog_vaddr.vaddr_start) / PG_SIZE;
         while(cnt < pg_cnt) {
             bitmap_set(&cur_thread->userprog_vaddr.vaddr_bitmap, bit_idx_start + cnt++, 0);
@@ -253,6 +254,14 @@ void mfree_page(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt) {
     }
 }
 
+/** 释放 get_pages 申请的 pg_cnt 页内存 */
+void free_pages(void* vaddr, uint32_t pg_cnt, enum pool_flags flag) {
+    struct pool* mem_pool = flag & PF_KERNEL ? &kernel_pool : &user_pool;
+    mutex_lock(&mem_pool->lock);
+    mfree_page(flag, vaddr, pg_cnt);
+    mutex_unlock(&mem_pool->lock);
+}
+
 /** 从物理内存池中申请 pg_cnt 页内存,成功则清零后返回其虚拟地址，失败返回 NULL */
 void* get_pages(uint32_t pg_cnt, enum pool_flags flag) {
     struct pool* mem_pool = flag & PF_KERNEL ? &kernel_pool : &user_pool;
@@ -278,9 +287,9 @@ void* get_one_page(enum pool_flags flag, uint32_t vaddr) {
 
     if (cur->pgdir != NULL && flag == PF_USER) {
         /* 若当前是用户进程申请用户内存,就修改用户进程自己的虚拟地址位图 */
-        bit_idx = (vaddr - cur->userprog_vaddr.vaddr_start) / PG_SIZE;
-        ASSERT(bit_idx > 0);
-        bitmap_set(&cur->userprog_vaddr.vaddr_bitmap, bit_idx, 1);
+        bit_idx = (vaddr - cur->leader->userprog_vaddr.vaddr_start) / PG_SIZE;
+        ASSERT(bit_idx >= 0);   // 池的第一页 USER_VADDR_START 正是 ELF 默认的加载地址
+        bitmap_set(&cur->leader->userprog_vaddr.vaddr_bitmap, bit_idx, 1);
         
     } else if (cur->pgdir == NULL && flag == PF_KERNEL){
         /* 如果是内核线程申请内核内存,就修改kernel_vaddr. */
@@ -340,7 +349,7 @@ void* sys_malloc(uint32_t size) {
         PF = PF_USER;
         mem_pool = &user_pool;
         pool_size = user_pool.pool_size;
-        descs = cur_thread->u_block_desc;
+        descs = cur_thread->leader->u_block_desc;
     }
  
     /* 若申请的内存不在内存池容量范围内则直接返回NULL */
@@ -466,6 +475,32 @@ void sys_free(void* ptr) {
     mutex_unlock(&mem_pool->lock);
 }
  
+/** 在内核空间分配内存，用户进程上下文中分配的也能被所有任务共享 */
+void* kmalloc(uint32_t size) {
+    // sys_malloc 根据 pgdir 决定用哪个内存池，因此将 cur->pgdir 临时置 NULL；
+    // 这个过程中不可以任务切换（时钟中断）
+    struct task_struct* cur = running_thread();
+    uint32_t* cur_pagedir_bak = cur->pgdir;
+    enum intr_status old_status = intr_disable();
+    cur->pgdir = NULL;
+    void* ptr = sys_malloc(size);
+    // 完成在内核空间分配后 恢复pgdir
+    cur->pgdir = cur_pagedir_bak;
+    intr_set_status(old_status);
+    return ptr;
+}
+
+/** 释放 kmalloc 分配的内存 */
+void kfree(void* ptr) {
+    struct task_struct* cur = running_thread();
+    uint32_t* cur_pagedir_bak = cur->pgdir;
+    enum intr_status old_status = intr_disable();
+    cur->pgdir = NULL;
+    sys_free(ptr);
+    cur->pgdir = cur_pagedir_bak;
+    intr_set_status(old_status);
+}
+
 /** 初始化内存池 */
 static void mem_pool_init(uint32_t all_mem) {
     put_str("     mem_pool_init start...\n");
@@ -51,6 +51,7 @@ void malloc_init(void);
 void block_desc_init(struct mem_block_desc* desc_array);
 
 void* get_pages(uint32_t pg_cnt, enum pool_flags flag);
+void  free_pages(void* vaddr, uint32_t pg_cnt, enum pool_flags flag);
 void* get_one_page(enum pool_flags flag, uint32_t vaddr);
 void* malloc_page(enum pool_flags pf, uint32_t pg_cnt);
 
@@ -63,6 +64,8 @@ void pfree(uint32_t pg_phy_addr);
 
 void* sys_malloc(uint32_t size);
 void  sys_free(void* ptr);
+void* kmalloc(uint32_t size);
+void  kfree(void* ptr);
 
 
 #endif
@@ -0,0 +1,84 @@
+/**************   处理器控制相关的内联函数   ***************
+ cpuid      -- 查询处理器特性
+ cr0 / cr4  -- 控制寄存器读写
+ clts/stts  -- 清除/设置 cr0.TS，用于 FPU 上下文的延迟切换
+*********************************************************/
+
+#ifndef __LIB_KERNEL_CPU_H
+#define __LIB_KERNEL_CPU_H
+#include "stdint.h"
+
+/* cr0 的一些位 */
+#define CR0_MP  (1 << 1)    // 与 TS 配合，wait/fwait 也触发 #NM
+#define CR0_EM  (1 << 2)    // 置 1 表示没有 FPU，浮点指令触发 #NM
+#define CR0_TS  (1 << 3)    // 任务切换后置 1，首条浮点指令触发 #NM
+#define CR0_NE  (1 << 5)    // 浮点错误走 #MF 而不是外部中断
+
+/* cr4 的一些位 */
+#define CR4_OSFXSR      (1 << 9)    // 操作系统支持 fxsave/fxrstor，开启 SSE
+#define CR4_OSXMMEXCPT  (1 << 10)   // SIMD 浮点异常走 #XF
+
+/* cpuid 1 号功能 edx 中的一些位 */
+#define CPUID_EDX_FPU   (1 << 0)
+#define CPUID_EDX_SEP   (1 << 11)   // 支持 sysenter/sysexit
+#define CPUID_EDX_FXSR  (1 << 24)
+#define CPUID_EDX_SSE   (1 << 25)
+
+/* 执行 cpuid 的 leaf 号功能 */
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile ("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf), "c" (0));
+}
+
+static inline uint32_t read_cr0(void) {
+    uint32_t cr0;
+    asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+    return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0) {
+    asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t cr4;
+    asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+    return cr4;
+}
+
+static inline void write_cr4(uint32_t cr4) {
+    asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+}
+
+/* sysenter 用到的 msr */
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t low, high;
+    asm volatile ("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile ("wrmsr" : : "c" (msr), "a" ((uint32_t)value), "d" ((uint32_t)(value >> 32)));
+}
+
+/* 读时间戳计数器，每个时钟周期加 1 */
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile ("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t)high << 32) | low;
+}
+
+/* 清 cr0.TS，之后的浮点指令不再触发 #NM */
+static inline void clts(void) {
+    asm volatile ("clts" : : : "memory");
+}
+
+/* 置 cr0.TS，下一条浮点指令触发 #NM */
+static inline void stts(void) {
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+#endif
@@ -31,6 +31,11 @@ static inline void outsw(uint16_t port, const void* addr, uint32_t word_cnt) {
 /******************************************************/
 }
 
+/** 将addr处起始的dword_cnt个双字写入端口port，设备支持 32 位数据口时 I/O 指令数比 outsw 少一半 */
+static inline void outsl(uint16_t port, const void* addr, uint32_t dword_cnt) {
+   asm volatile ("cld; rep outsl" : "+S" (addr), "+c" (dword_cnt) : "d" (port));
+}
+
 /* 将从端口port读入的一个字节返回 */
 static inline uint8_t inb(uint16_t port) {
    uint8_t data;
@@ -38,6 +43,18 @@ static inline uint8_t inb(uint16_t port) {
    return data;
 }
 
+/* 向端口port写入一个双字，PCI 配置空间等 32 位端口用 */
+static inline void outl(uint16_t port, uint32_t data) {
+   asm volatile ("outl %0, %w1" : : "a" (data), "Nd" (port));
+}
+
+/* 将从端口port读入的一个双字返回 */
+static inline uint32_t inl(uint16_t port) {
+   uint32_t data;
+   asm volatile ("inl %w1, %0" : "=a" (data) : "Nd" (port));
+   return data;
+}
+
 /** 将从端口port读入的word_cnt个字写入addr */
 static inline void insw(uint16_t port, void* addr, uint32_t word_cnt) {
 /******************************************************
@@ -48,4 +65,9 @@ static inline void insw(uint16_t port, void* addr, uint32_t word_cnt) {
 /******************************************************/
 }
 
+/** 将从端口port读入的dword_cnt个双字写入addr */
+static inline void insl(uint16_t port, void* addr, uint32_t dword_cnt) {
+   asm volatile ("cld; rep insl" : "+D" (addr), "+c" (dword_cnt) : "d" (port) : "memory");
+}
+
 #endif
@@ -3,10 +3,10 @@
 #include "global.h"
 
 // 某成员在结构中的偏移量
-#define offset(struct_type, member) (int)(&((struct_type*)0)->member)
+#define offset(struct_type, member) (int)((char*)&((struct_type*)0)->member - (char*)0)
 // 结构A有成员a，已知 a 的指针 a_ptr，则 A_ptr 为：a指针 - a在本结构的偏移量
 #define elem2entry(struct_type, struct_member_name, elem_ptr) \
-	 (struct_type*)((int)elem_ptr - offset(struct_type, struct_member_name))
+	 (struct_type*)((char*)(elem_ptr) - offset(struct_type, struct_member_name))
 
 /**********   定义链表结点成员结构   ***********
 *结点中不需要数据成元,只要求前驱和后继结点指针*/
@@ -3,9 +3,9 @@
 typedef signed char int8_t;
 typedef signed short int int16_t;
 typedef signed int int32_t;
-typedef signed long long int int64_t;
+typedef __INT64_TYPE__ int64_t;          // 用编译器给的 64 位类型，在宿主机上与 libc 的定义一致
 typedef unsigned char uint8_t;
 typedef unsigned short int uint16_t;
 typedef unsigned int uint32_t;
-typedef unsigned long long int uint64_t;
+typedef __UINT64_TYPE__ uint64_t;
 #endif
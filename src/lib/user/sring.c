@@ -0,0 +1,44 @@
+#include "sring.h"
+#include "syscall.h"
+#include "global.h"
+
+/** 取一个空闲的提交项，提交队列已满返回 NULL。填好后调用 sring_submit 发布 */
+struct sring_sqe* sring_get_sqe(struct sring* ring) {
+    if (ring->sqe_tail - ring->sq_head >= SRING_ENTRIES) {
+        return NULL;
+    }
+    struct sring_sqe* sqe = &ring->sqes[ring->sqe_tail & SRING_MASK];
+    ring->sqe_tail++;
+    return sqe;
+}
+
+/** 发布已填好的提交项，并等待至少 wait_nr 个完成项。
+ * 轮询模式下只在轮询线程睡眠或需要等待时才陷入内核。返回 sring_enter 的结果，未陷入返回 0 */
+int32_t sring_submit(struct sring* ring, uint32_t wait_nr) {
+    uint32_t to_submit = ring->sqe_tail - ring->sq_tail;
+    sring_barrier();            // 提交项写完之后才能发布 tail
+    ring->sq_tail = ring->sqe_tail;
+    sring_barrier();
+    if (ring->flags & SRING_SQPOLL) {
+        if (!(ring->flags & SRING_NEED_WAKEUP) && wait_nr == 0) {
+            return 0;
+        }
+        return sring_enter(0, wait_nr);
+    }
+    return sring_enter(to_submit, wait_nr);
+}
+
+/** 最早的未处理完成项，没有返回 NULL */
+struct sring_cqe* sring_peek_cqe(struct sring* ring) {
+    if (ring->cq_head == ring->cq_tail) {
+        return NULL;
+    }
+    sring_barrier();
+    return &ring->cqes[ring->cq_head & SRING_MASK];
+}
+
+/** 标记 sring_peek_cqe 返回的完成项已处理，内核可以复用它 */
+void sring_cqe_seen(struct sring* ring) {
+    sring_barrier();
+    ring->cq_head++;
+}
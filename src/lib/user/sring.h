@@ -0,0 +1,63 @@
+#ifndef __LIB_USER_SRING_H
+#define __LIB_USER_SRING_H
+#include "stdint.h"
+
+#define SRING_ENTRIES 128           // 提交、完成队列的项数，必须是 2 的幂
+#define SRING_MASK (SRING_ENTRIES - 1)
+
+/* sring_setup 的标志，也会记录在 sring.flags 中 */
+#define SRING_SQPOLL        1       // 由内核线程轮询提交队列，提交不必陷入内核
+/* sring.flags 中由内核设置的状态 */
+#define SRING_NEED_WAKEUP   2       // 轮询线程空闲太久已睡眠，需要 sring_enter 唤醒
+
+/* 编译器屏障。单处理器上写共享环只需保证编译器不乱序 */
+#define sring_barrier() asm volatile ("" : : : "memory")
+
+/* 可以提交的操作 */
+enum sring_op {
+    SRING_OP_NOP,
+    SRING_OP_WRITE,     // addr 为字符串，输出到控制台
+    SRING_OP_OPEN,      // addr 为路径，len 为打开标志
+    SRING_OP_CLOSE,     // 关闭 fd
+    SRING_OP_MALLOC,    // 分配 len 字节
+    SRING_OP_FREE,      // 释放 addr
+    SRING_OP_READ       // 从 fd 读 len 字节到 addr
+};
+
+/* 提交队列项 */
+struct sring_sqe {
+    uint8_t  opcode;
+    uint8_t  pad[3];
+    int32_t  fd;
+    uint32_t addr;
+    uint32_t len;
+    uint32_t user_data;     // 原样带回完成项，用来对应请求
+};
+
+/* 完成队列项 */
+struct sring_cqe {
+    uint32_t user_data;
+    int32_t  res;           // 对应系统调用的返回值
+};
+
+/* 用户进程与内核共享的一页。head 由消费方推进，tail 由生产方推进，下标对 SRING_ENTRIES 取模 */
+struct sring {
+    volatile uint32_t sq_head;      // 内核已取走的位置
+    volatile uint32_t sq_tail;      // 用户已发布的位置
+    volatile uint32_t cq_head;      // 用户已处理的位置
+    volatile uint32_t cq_tail;      // 内核已写完的位置
+    volatile uint32_t flags;
+    uint32_t sqe_tail;              // 用户已填好、尚未发布的位置，内核不使用
+    struct sring_sqe sqes[SRING_ENTRIES];
+    struct sring_cqe cqes[SRING_ENTRIES];
+};
+
+struct sring* sring_setup(uint32_t flags);
+int32_t sring_enter(uint32_t to_submit, uint32_t min_complete);
+
+struct sring_sqe* sring_get_sqe(struct sring* ring);
+int32_t sring_submit(struct sring* ring, uint32_t wait_nr);
+struct sring_cqe* sring_peek_cqe(struct sring* ring);
+void sring_cqe_seen(struct sring* ring);
+
+#endif
@@ -1,61 +1,78 @@
 #include "syscall.h"
+#include "global.h"
+#include "sring.h"
 
-// 大括号中最后一个语句的值会作为大括号代码块的返回值，而且最后语句后要加分号
+#define CPUID_EDX_SEP   (1 << 11)   // cpu 支持 sysenter/sysexit
+
+/** cpu 是否支持 sysenter，第一次调用时用 cpuid 检测，内核在同样条件下设置好了 msr */
+static bool sysenter_supported(void) {
+    static int8_t supported = -1;
+    if (supported < 0) {
+        uint32_t eax, ebx, ecx, edx;
+        asm volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1), "c" (0));
+        supported = (edx & CPUID_EDX_SEP) != 0;
+    }
+    return supported;
+}
+
+/** 发起系统调用：eax 为调用号，ebx ecx edx esi edi 为参数，返回值在 eax 中。
+ * 优先走 sysenter：栈顶压入返回地址和 ebp 并让 ebp 指向它们，内核据此经 sysexit 返回；
+ * 不支持时走 int 0x80，它保存完整的中断现场，开销大得多 */
+static int32_t do_syscall(uint32_t nr, uint32_t arg1, uint32_t arg2, uint32_t arg3,
+                          uint32_t arg4, uint32_t arg5) {
+    int32_t retval;
+    if (sysenter_supported()) {
+        asm volatile (
+            "push %%ebp\n\t"
+            "push $1f\n\t"
+            "mov %%esp, %%ebp\n\t"
+            "sysenter\n"
+            "1:\n\t"
+            "add $4, %%esp\n\t"
+            "pop %%ebp"
+            : "=a" (retval), "+c" (arg2), "+d" (arg3)
+            : "0" (nr), "b" (arg1), "S" (arg4), "D" (arg5)
+            : "memory"
+        );
+    } else {
+        asm volatile (
+            "int $0x80"
+            : "=a" (retval)
+            : "0" (nr), "b" (arg1), "c" (arg2), "d" (arg3), "S" (arg4), "D" (arg5)
+            : "memory"
+        );
+    }
+    return retval;
+}
 
 // 无参数的系统调用
-#define _syscall0(NUMBER) ({    \
-    int retval;                 \
-    asm volatile (              \
-        "int $0x80"             \
-        : "=a" (retval)         \
-        : "a" (NUMBER)          \
-        : "memory"              \
-    );                          \
-    retval;                     \
-})
+#define _syscall0(NUMBER) do_syscall(NUMBER, 0, 0, 0, 0, 0)
 
 /* 一个参数的系统调用 */
-#define _syscall1(NUMBER, ARG1) ({  \
-    int retval;                     \
-    asm volatile (                  \
-        "int $0x80"                 \
-        : "=a" (retval)             \
-        : "a" (NUMBER), "b" (ARG1)  \
-        : "memory"                  \
-    );                              \
-    retval;                         \
-})
+#define _syscall1(NUMBER, ARG1) do_syscall(NUMBER, (uint32_t)(ARG1), 0, 0, 0, 0)
 
 /* 两个参数的系统调用 */
-#define _syscall2(NUMBER, ARG1, ARG2) ({        \
-    int retval;                                 \
-    asm volatile (                              \
-        "int $0x80"                             \
-        : "=a" (retval)                         \
-        : "a" (NUMBER), "b" (ARG1), "c" (ARG2)  \
-        : "memory"                              \
-    );                                          \
-    retval;                                     \
-})
+#define _syscall2(NUMBER, ARG1, ARG2) do_syscall(NUMBER, (uint32_t)(ARG1), (uint32_t)(ARG2), 0, 0, 0)
 
 /* 三个参数的系统调用 */
-#define _syscall3(NUMBER, ARG1, ARG2, ARG3) ({              \
-    int retval;                                             \
-    asm volatile (                                          \
-        "int $0x80"                                         \
-        : "=a" (retval)                                     \
-        : "a" (NUMBER), "b" (ARG1), "c" (ARG2), "d" (ARG3)  \
-        : "memory"                                          \
-    );                                                      \
-    retval;                                                 \
-})
+#define _syscall3(NUMBER, ARG1, ARG2, ARG3) \
+    do_syscall(NUMBER, (uint32_t)(ARG1), (uint32_t)(ARG2), (uint32_t)(ARG3), 0, 0)
+
+/* 四个参数的系统调用 */
+#define _syscall4(NUMBER, ARG1, ARG2, ARG3, ARG4) \
+    do_syscall(NUMBER, (uint32_t)(ARG1), (uint32_t)(ARG2), (uint32_t)(ARG3), (uint32_t)(ARG4), 0)
+
+/* 五个参数的系统调用，ebp 留给 sysenter 传用户栈，最多 5 个 */
+#define _syscall5(NUMBER, ARG1, ARG2, ARG3, ARG4, ARG5) \
+    do_syscall(NUMBER, (uint32_t)(ARG1), (uint32_t)(ARG2), (uint32_t)(ARG3), \
+               (uint32_t)(ARG4), (uint32_t)(ARG5))
 
 /** 返回当前任务 pid */
 uint32_t getpid() {
     return _syscall0(SYS_GETPID);
 }
 
-uint32_t write(char* str) {
+int32_t write(char* str) {
     return _syscall1(SYS_WRITE, str);
 }
 
@@ -67,3 +84,69 @@ void free(void* ptr) {
     _syscall1(SYS_FREE, ptr);
 }
 
+/** 新线程从这里开始执行 func(arg)，func 返回即以 0 退出 */
+static void uthread_entry(void (*func)(void*), void* arg) {
+    func(arg);
+    uthread_exit(0);
+}
+
+/** 在本进程中创建线程执行 func(arg)，返回线程号，失败返回 -1 */
+int32_t uthread_create(void (*func)(void*), void* arg) {
+    return _syscall3(SYS_THREAD_CREATE, uthread_entry, func, arg);
+}
+
+/** 等待线程 tid 退出并取得其退出码 */
+int32_t uthread_join(int32_t tid, int32_t* status) {
+    return _syscall2(SYS_THREAD_JOIN, tid, status);
+}
+
+/** 当前线程退出 */
+void uthread_exit(int32_t status) {
+    _syscall1(SYS_THREAD_EXIT, status);
+}
+
+/** *uaddr 仍等于 val 时睡眠，直到有人 futex_wake(uaddr) */
+int32_t futex_wait(uint32_t* uaddr, uint32_t val) {
+    return _syscall2(SYS_FUTEX_WAIT, uaddr, val);
+}
+
+/** 唤醒最多 nr_wake 个睡在 uaddr 上的线程 */
+int32_t futex_wake(uint32_t* uaddr, uint32_t nr_wake) {
+    return _syscall2(SYS_FUTEX_WAKE, uaddr, nr_wake);
+}
+
+/** 打印所有线程的 cpu 时间统计及最近 nr_events 条调度事件 */
+void ps(uint32_t nr_events) {
+    _syscall1(SYS_PS, nr_events);
+}
+
+
+/** 打印各系统调用的调用次数和延迟直方图 */
+void syscall_stats(void) {
+    _syscall0(SYS_SYSCALL_STATS);
+}
+
+/** 建立批量提交环，flags 为 SRING_SQPOLL 时由内核线程轮询提交队列 */
+struct sring* sring_setup(uint32_t flags) {
+    return (struct sring*)_syscall1(SYS_SRING_SETUP, flags);
+}
+
+/** 提交至多 to_submit 个请求，轮询模式下等待至少 min_complete 个完成项 */
+int32_t sring_enter(uint32_t to_submit, uint32_t min_complete) {
+    return _syscall2(SYS_SRING_ENTER, to_submit, min_complete);
+}
+
+/** 从文件 fd 读 count 字节到 buf */
+int32_t read(int32_t fd, void* buf, uint32_t count) {
+    return _syscall3(SYS_READ, fd, buf, count);
+}
+
+/** 用 path 处的 ELF 可执行文件替换当前进程，成功不返回 */
+int32_t execv(const char* path, char* const argv[]) {
+    return _syscall2(SYS_EXECV, path, argv);
+}
+
+/** 打印各硬盘及分区的读写次数、服务时间和延迟直方图 */
+void disk_stats(void) {
+    _syscall0(SYS_DISK_STATS);
+}
@@ -7,13 +7,39 @@ enum SYSCALL_NR {
 	SYS_GETPID,
 	SYS_WRITE,
 	SYS_MALLOC,
-	SYS_FREE
+	SYS_FREE,
+	SYS_PS,
+	SYS_THREAD_CREATE,
+	SYS_THREAD_JOIN,
+	SYS_THREAD_EXIT,
+	SYS_FUTEX_WAIT,
+	SYS_FUTEX_WAKE,
+	SYS_SYSCALL_STATS,
+	SYS_SRING_SETUP,
+	SYS_SRING_ENTER,
+	SYS_READ,
+	SYS_EXECV,
+	SYS_DISK_STATS
 };
 
 uint32_t getpid(void);
-uint32_t write(char* str);
+int32_t  write(char* str);
 void* malloc(uint32_t size);
 void  free(void* ptr);
+void  ps(uint32_t nr_events);
+
+int32_t uthread_create(void (*func)(void*), void* arg);
+int32_t uthread_join(int32_t tid, int32_t* status);
+void    uthread_exit(int32_t status);
+
+int32_t futex_wait(uint32_t* uaddr, uint32_t val);
+int32_t futex_wake(uint32_t* uaddr, uint32_t nr_wake);
+
+void syscall_stats(void);
+
+int32_t read(int32_t fd, void* buf, uint32_t count);
+int32_t execv(const char* path, char* const argv[]);
+void    disk_stats(void);
 
 #endif
 
@@ -0,0 +1,78 @@
+#include "usync.h"
+#include "syscall.h"
+
+/** 若 *ptr 等于 expected 则写入 desired，返回 *ptr 原来的值 */
+static inline uint32_t cmpxchg(volatile uint32_t* ptr, uint32_t expected, uint32_t desired) {
+    uint32_t old;
+    asm volatile ("lock cmpxchgl %2, %1" : "=a" (old), "+m" (*ptr) : "r" (desired), "0" (expected) : "memory");
+    return old;
+}
+
+/** 把 value 写入 *ptr，返回原来的值。xchg 访问内存时自带 lock */
+static inline uint32_t xchg(volatile uint32_t* ptr, uint32_t value) {
+    asm volatile ("xchgl %0, %1" : "+r" (value), "+m" (*ptr) : : "memory");
+    return value;
+}
+
+/** *ptr 加上 value，返回原来的值 */
+static inline uint32_t fetch_add(volatile uint32_t* ptr, uint32_t value) {
+    asm volatile ("lock xaddl %0, %1" : "+r" (value), "+m" (*ptr) : : "memory");
+    return value;
+}
+
+void umutex_init(struct umutex* mutex) {
+    mutex->state = 0;
+}
+
+/** 无竞争时一条 cmpxchg 拿到锁，不进内核；有竞争时把 state 置 2 后在 futex 上睡眠 */
+void umutex_lock(struct umutex* mutex) {
+    uint32_t c = cmpxchg(&mutex->state, 0, 1);
+    if (c == 0) {
+        return;
+    }
+    if (c != 2) {
+        c = xchg(&mutex->state, 2);
+    }
+    while (c != 0) {
+        futex_wait((uint32_t*)&mutex->state, 2);
+        c = xchg(&mutex->state, 2);
+    }
+}
+
+bool umutex_trylock(struct umutex* mutex) {
+    return cmpxchg(&mutex->state, 0, 1) == 0;
+}
+
+/** 无人等待(state 为 1)时只做一次原子减，否则清零并唤醒一个等待者 */
+void umutex_unlock(struct umutex* mutex) {
+    if (fetch_add(&mutex->state, (uint32_t)-1) != 1) {
+        mutex->state = 0;
+        futex_wake((uint32_t*)&mutex->state, 1);
+    }
+}
+
+void ucond_init(struct ucond* cond) {
+    cond->seq = 0;
+}
+
+/** 放开 mutex 等待 signal，醒来后重新持有 mutex。和 pthread 一样，调用者要在循环中重新检查条件 */
+void ucond_wait(struct ucond* cond, struct umutex* mutex) {
+    uint32_t seq = cond->seq;
+    umutex_unlock(mutex);
+    // 放锁之后若已有 signal 改了 seq，futex_wait 会立即返回，不会丢失唤醒
+    futex_wait((uint32_t*)&cond->seq, seq);
+    // 可能还有别的等待者同时醒来，按有竞争的方式加锁，保证解锁时会唤醒它们
+    while (xchg(&mutex->state, 2) != 0) {
+        futex_wait((uint32_t*)&mutex->state, 2);
+    }
+}
+
+void ucond_signal(struct ucond* cond) {
+    fetch_add(&cond->seq, 1);
+    futex_wake((uint32_t*)&cond->seq, 1);
+}
+
+void ucond_broadcast(struct ucond* cond) {
+    fetch_add(&cond->seq, 1);
+    futex_wake((uint32_t*)&cond->seq, 0x7fffffff);
+}
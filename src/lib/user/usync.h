@@ -0,0 +1,26 @@
+#ifndef __LIB_USER_USYNC_H
+#define __LIB_USER_USYNC_H
+#include "stdint.h"
+#include "global.h"
+
+/* 用户态互斥锁。state: 0 空闲，1 被持有且无人等待，2 被持有且可能有人在 futex 上等待 */
+struct umutex {
+    volatile uint32_t state;
+};
+
+/* 用户态条件变量。seq 每次 signal/broadcast 加 1，等待者在 seq 上睡眠 */
+struct ucond {
+    volatile uint32_t seq;
+};
+
+void umutex_init(struct umutex* mutex);
+void umutex_lock(struct umutex* mutex);
+bool umutex_trylock(struct umutex* mutex);
+void umutex_unlock(struct umutex* mutex);
+
+void ucond_init(struct ucond* cond);
+void ucond_wait(struct ucond* cond, struct umutex* mutex);
+void ucond_signal(struct ucond* cond);
+void ucond_broadcast(struct ucond* cond);
+
+#endif
@@ -2,52 +2,203 @@
 #include "interrupt.h"
 #include "debug.h"
 
-void sema_init(struct semaphore *sem, uint8_t value) {
+#define PI_MAX_DEPTH 8	// 优先级沿持锁链最多传递的层数，防止锁环导致死循环
+#define MUTEX_SPIN_LIMIT 1000	// 持有者在别的 cpu 上运行时，阻塞前最多自旋的次数
+
+void sema_init(struct semaphore *sem, uint32_t value) {
 	sem->value = value;
 	list_init(&sem->waiters);
 }
 
+/* 当前线程挂到 psem 的等待队列上并阻塞，需在关中断下调用 */
+static void sema_block(struct semaphore* psem) {
+	struct list_elem* cur = &(running_thread()->general_tag);
+	if (elem_find(&psem->waiters, cur)) {
+		PANIC("blocked thread found in waiters list \n");
+	}
+	list_append(&psem->waiters, cur);
+	thread_block(TASK_BLOCKED);
+}
+
 void sema_p(struct semaphore* psem) {
 	enum intr_status old = intr_disable();
 
 	while (psem->value == 0) {
-		struct list_elem* cur = &(running_thread()->general_tag);
-		if (elem_find(&psem->waiters, cur)) {
-			PANIC("blocked thread found in waiters list \n");
+		sema_block(psem);
+	}
+	psem->value --;
+	intr_set_status(old);
+}
+
+/* 当前线程挂到 waiters 上阻塞，最多 timeout_ticks 个嘀嗒，超时返回 false。需在关中断下调用 */
+static bool block_timeout(struct list* waiters, uint32_t timeout_ticks) {
+	struct task_struct* cur = running_thread();
+	list_append(waiters, &cur->general_tag);
+	cur->wait_list = waiters;
+	timer_arm(cur, timeout_ticks);
+	thread_block(TASK_BLOCKED);
+	return !cur->timed_out;
+}
+
+/* P 操作，最多等 m_seconds 毫秒，超时返回 false */
+bool sema_p_timeout(struct semaphore* psem, uint32_t m_seconds) {
+	enum intr_status old = intr_disable();
+	uint32_t deadline = ticks + ms_to_ticks(m_seconds);
+	while (psem->value == 0) {
+		int32_t left = (int32_t)(deadline - ticks);
+		if (left <= 0 || !block_timeout(&psem->waiters, left)) {
+			intr_set_status(old);
+			return false;
 		}
-		list_append(&psem->waiters, cur);
-		thread_block(TASK_BLOCKED);
 	}
 	psem->value --;
 	intr_set_status(old);
+	return true;
+}
+
+/* 不阻塞的 P 操作，信号量为 0 时返回 false */
+bool sema_try_p(struct semaphore* psem) {
+	enum intr_status old = intr_disable();
+	bool got = psem->value > 0;
+	if (got) {
+		psem->value --;
+	}
+	intr_set_status(old);
+	return got;
+}
+
+/* 等待者中优先级最高的线程，同优先级取先来的；没有等待者返回 NULL */
+static struct task_struct* sema_top_waiter(struct semaphore* psem) {
+	struct task_struct* top = NULL;
+	struct list_elem* elem = psem->waiters.head.next;
+	while (elem != &psem->waiters.tail) {
+		struct task_struct* waiter = elem2entry(struct task_struct, general_tag, elem);
+		if (top == NULL || waiter->priority > top->priority) {
+			top = waiter;
+		}
+		elem = elem->next;
+	}
+	return top;
 }
 
 void sema_v(struct semaphore* psem) {
 	enum intr_status old = intr_disable();
 	psem->value ++;
-	if (!list_empty(&psem->waiters)) {
-		struct list_elem* elem = list_pop(&psem->waiters);
-		struct task_struct* blocked = elem2entry(struct task_struct, general_tag, elem);
+	struct task_struct* blocked = sema_top_waiter(psem);
+	if (blocked != NULL) {
+		list_remove(&blocked->general_tag);
 		thread_unblock(blocked);
 	}
 	intr_set_status(old);
 }
 
+/* 把 prio 沿 pmutex 的持有者链传下去：A 等 B 持有的锁，B 又在等 C 持有的锁... */
+static void mutex_boost_chain(struct mutex_t* pmutex, uint8_t prio) {
+	uint8_t depth = 0;
+	while (pmutex != NULL && depth++ < PI_MAX_DEPTH) {
+		struct task_struct* holder = pmutex->holder;
+		if (holder == NULL || holder->priority >= prio) {
+			break;
+		}
+		thread_set_priority(holder, prio);
+		pmutex = holder->blocked_on;
+	}
+}
+
+/* 有效优先级 = max(基础优先级, 所持各锁上等待者的有效优先级) */
+static void mutex_restore_prio(struct task_struct* pthread) {
+	uint8_t prio = pthread->base_priority;
+	struct list_elem* elem = pthread->held_mutexes.head.next;
+	while (elem != &pthread->held_mutexes.tail) {
+		struct mutex_t* pmutex = elem2entry(struct mutex_t, holder_tag, elem);
+		struct task_struct* waiter = sema_top_waiter(&pmutex->semaphore);
+		if (waiter != NULL && waiter->priority > prio) {
+			prio = waiter->priority;
+		}
+		elem = elem->next;
+	}
+	thread_set_priority(pthread, prio);
+}
+
 void mutex_init(struct mutex_t* pmutex) {
 	pmutex->holder = NULL;
 	pmutex->holder_repeat_nr = 0;
+	pmutex->nr_acquire = pmutex->nr_contended = pmutex->nr_spin_acquire = 0;
 	sema_init(&pmutex->semaphore, 1);
 }
 
+/* 锁空闲则由 cur 拿走，需在关中断下调用 */
+static bool mutex_grab(struct mutex_t* pmutex, struct task_struct* cur) {
+	if (pmutex->semaphore.value == 0) {
+		return false;
+	}
+	pmutex->semaphore.value --;
+	pmutex->holder = cur;
+	pmutex->holder_repeat_nr = 1;
+	pmutex->nr_acquire ++;
+	list_append(&cur->held_mutexes, &pmutex->holder_tag);
+	return true;
+}
+
+/* 不阻塞地加锁，成功返回 true */
+bool mutex_trylock(struct mutex_t* pmutex) {
+	struct task_struct* cur = running_thread();
+	if (pmutex->holder == cur) {
+		pmutex->holder_repeat_nr ++;
+		return true;
+	}
+	enum intr_status old = intr_disable();
+	bool got = mutex_grab(pmutex, cur);
+	intr_set_status(old);
+	return got;
+}
+
+#if NR_CPUS > 1
+/* 持有者正在别的 cpu 上跑，临界区一般只有几百条指令，自旋等它比阻塞+切换便宜。
+ * 持有者换人或下了 cpu 就不值得再等，返回 false 去阻塞 */
+static bool mutex_spin_on_owner(struct mutex_t* pmutex) {
+	struct task_struct* owner = pmutex->holder;
+	uint32_t spins = 0;
+	while (spins++ < MUTEX_SPIN_LIMIT && pmutex->holder == owner && owner != NULL && 
+		   owner->status == TASK_RUNNING && owner->cpu != cpu_id()) {
+		asm volatile ("pause" : : : "memory");
+	}
+	return pmutex->semaphore.value != 0;
+}
+#endif
+
 void mutex_lock(struct mutex_t* pmutex) {
 	struct task_struct* cur = running_thread();
-	if (pmutex->holder != cur)	{
-		sema_p(&pmutex->semaphore);
-		pmutex->holder = cur;
-		pmutex->holder_repeat_nr = 1;
-	} else {
+	if (pmutex->holder == cur) {
 		pmutex->holder_repeat_nr ++;
+		return;
+	}
+	enum intr_status old = intr_disable();
+	/* 快速路径：锁空闲时直接拿走，不碰等待队列也不做优先级继承 */
+	if (mutex_grab(pmutex, cur)) {
+		intr_set_status(old);
+		return;
+	}
+	pmutex->nr_contended ++;
+#if NR_CPUS > 1
+	intr_set_status(old);
+	bool spun = mutex_spin_on_owner(pmutex);
+	old = intr_disable();
+	if (spun && mutex_grab(pmutex, cur)) {
+		pmutex->nr_spin_acquire ++;
+		intr_set_status(old);
+		return;
 	}
+#endif
+	/* 慢速路径：阻塞。单处理器下持有者此刻必然不在运行，自旋没有意义。
+	 * 被唤醒后锁可能又被别人抢走，每次阻塞前都要把优先级借给当时的持有者 */
+	do {
+		cur->blocked_on = pmutex;
+		mutex_boost_chain(pmutex, cur->priority);
+		sema_block(&pmutex->semaphore);
+	} while (!mutex_grab(pmutex, cur));
+	cur->blocked_on = NULL;
+	intr_set_status(old);
 }
 
 void mutex_unlock(struct mutex_t* pmutex) {
@@ -55,8 +206,117 @@ void mutex_unlock(struct mutex_t* pmutex) {
 		pmutex->holder_repeat_nr--;
 	} else {
 		ASSERT(pmutex->holder_repeat_nr == 1);
+		enum intr_status old = intr_disable();
+		struct task_struct* cur = pmutex->holder;
 		pmutex->holder = NULL;
 		pmutex->holder_repeat_nr = 0;
+		list_remove(&pmutex->holder_tag);
+		// 归还因本锁借来的优先级，仍持有的其它锁上的等待者照算
+		mutex_restore_prio(cur);
 		sema_v(&pmutex->semaphore);
+		intr_set_status(old);
+	}
+}
+
+void wait_queue_init(struct wait_queue* wq) {
+	list_init(&wq->waiters);
+}
+
+/* 在 wq 上睡眠，被唤醒返回 true，超时返回 false；timeout_ticks 为 0 表示不限时。需在关中断下调用 */
+bool wait_queue_sleep(struct wait_queue* wq, uint32_t timeout_ticks) {
+	ASSERT(intr_get_status() == INTR_OFF);
+	if (timeout_ticks != 0) {
+		return block_timeout(&wq->waiters, timeout_ticks);
 	}
+	list_append(&wq->waiters, &running_thread()->general_tag);
+	thread_block(TASK_BLOCKED);
+	return true;
+}
+
+/* 唤醒 wq 上最早睡下的线程 */
+void wake_up(struct wait_queue* wq) {
+	enum intr_status old = intr_disable();
+	if (!list_empty(&wq->waiters)) {
+		struct list_elem* elem = list_pop(&wq->waiters);
+		thread_unblock(elem2entry(struct task_struct, general_tag, elem));
+	}
+	intr_set_status(old);
+}
+
+/* 唤醒 wq 上所有线程，由它们各自重新检查条件 */
+void wake_up_all(struct wait_queue* wq) {
+	enum intr_status old = intr_disable();
+	while (!list_empty(&wq->waiters)) {
+		struct list_elem* elem = list_pop(&wq->waiters);
+		thread_unblock(elem2entry(struct task_struct, general_tag, elem));
+	}
+	intr_set_status(old);
+}
+
+void rwsem_init(struct rw_semaphore* rwsem) {
+	rwsem->readers = 0;
+	rwsem->writer = false;
+	list_init(&rwsem->read_waiters);
+	list_init(&rwsem->write_waiters);
+}
+
+/* 把锁直接交给下一个等待的写者，被唤醒的写者无需再检查条件 */
+static void rwsem_grant_writer(struct rw_semaphore* rwsem) {
+	struct list_elem* elem = list_pop(&rwsem->write_waiters);
+	rwsem->writer = true;
+	thread_unblock(elem2entry(struct task_struct, general_tag, elem));
+}
+
+/* 一次性把锁交给所有等待的读者 */
+static void rwsem_grant_readers(struct rw_semaphore* rwsem) {
+	while (!list_empty(&rwsem->read_waiters)) {
+		struct list_elem* elem = list_pop(&rwsem->read_waiters);
+		rwsem->readers ++;
+		thread_unblock(elem2entry(struct task_struct, general_tag, elem));
+	}
+}
+
+void down_read(struct rw_semaphore* rwsem) {
+	enum intr_status old = intr_disable();
+	if (!rwsem->writer && list_empty(&rwsem->write_waiters)) {
+		rwsem->readers ++;
+	} else {
+		// 醒来时释放者已替本线程把 readers 加上
+		list_append(&rwsem->read_waiters, &running_thread()->general_tag);
+		thread_block(TASK_BLOCKED);
+	}
+	intr_set_status(old);
+}
+
+void up_read(struct rw_semaphore* rwsem) {
+	enum intr_status old = intr_disable();
+	ASSERT(rwsem->readers > 0 && !rwsem->writer);
+	if (--rwsem->readers == 0 && !list_empty(&rwsem->write_waiters)) {
+		rwsem_grant_writer(rwsem);
+	}
+	intr_set_status(old);
+}
+
+void down_write(struct rw_semaphore* rwsem) {
+	enum intr_status old = intr_disable();
+	if (!rwsem->writer && rwsem->readers == 0) {
+		rwsem->writer = true;
+	} else {
+		// 醒来时释放者已替本线程把 writer 置上
+		list_append(&rwsem->write_waiters, &running_thread()->general_tag);
+		thread_block(TASK_BLOCKED);
+	}
+	intr_set_status(old);
+}
+
+void up_write(struct rw_semaphore* rwsem) {
+	enum intr_status old = intr_disable();
+	ASSERT(rwsem->writer && rwsem->readers == 0);
+	rwsem->writer = false;
+	if (!list_empty(&rwsem->write_waiters)) {
+		rwsem_grant_writer(rwsem);
+	} else {
+		rwsem_grant_readers(rwsem);
+	}
+	intr_set_status(old);
 }
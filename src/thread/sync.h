@@ -4,22 +4,46 @@
 #include "list.h"
 #include "stdint.h"
 #include "thread.h"
+#include "interrupt.h"
+#include "timer.h"
 
 struct semaphore {
-	uint8_t	value;
+	uint32_t value;
 	struct  list waiters; 
 };
 
+/* 通用等待队列：线程在条件满足前睡在上面，由条件的修改者唤醒 */
+struct wait_queue {
+	struct list waiters;
+};
+
 struct mutex_t {
 	struct task_struct* holder;
 	struct semaphore semaphore;
 	uint32_t holder_repeat_nr;	
+	struct list_elem holder_tag;	// 持有者 held_mutexes 中的结点
+	uint32_t nr_acquire;		// 加锁次数
+	uint32_t nr_contended;		// 其中锁已被占用、需要自旋或阻塞的次数
+	uint32_t nr_spin_acquire;	// 其中自旋期间等到锁、免于阻塞的次数
 };
 
-void sema_init(struct semaphore *sem, uint8_t value);
+/* 读写信号量：读者之间可并发，写者独占。
+ * 写者优先：有写者在等时，新来的读者也要排队；写者释放后一次唤醒所有等待的读者 */
+struct rw_semaphore {
+	uint32_t readers;			// 正持有的读者数
+	bool writer;				// 是否被写者持有
+	struct list read_waiters;	// 等待的读者
+	struct list write_waiters;	// 等待的写者
+};
+
+void sema_init(struct semaphore *sem, uint32_t value);
 
 void sema_p(struct semaphore* psem);
 
+bool sema_p_timeout(struct semaphore* psem, uint32_t m_seconds);
+
+bool sema_try_p(struct semaphore* psem);
+
 void sema_v(struct semaphore* psem);
 
 
@@ -27,7 +51,46 @@ void mutex_init(struct mutex_t* pmutex);
 
 void mutex_lock(struct mutex_t* pmutex);
 
+bool mutex_trylock(struct mutex_t* pmutex);
+
 void mutex_unlock(struct mutex_t* pmutex);
 
 
+void wait_queue_init(struct wait_queue* wq);
+
+bool wait_queue_sleep(struct wait_queue* wq, uint32_t timeout_ticks);
+
+void wake_up(struct wait_queue* wq);
+
+void wake_up_all(struct wait_queue* wq);
+
+/* 在 wq 上等待 condition 成立，最多等 m_seconds 毫秒。
+ * 条件成立返回剩余的嘀嗒数(至少为1)，超时且条件仍不成立返回 0 */
+#define wait_event_timeout(wq, condition, m_seconds) ({					\
+	uint32_t __deadline = ticks + ms_to_ticks(m_seconds);				\
+	int32_t __left = 1;													\
+	enum intr_status __old = intr_disable();							\
+	while (!(condition)) {												\
+		__left = (int32_t)(__deadline - ticks);							\
+		if (__left <= 0 || !wait_queue_sleep((wq), __left)) {			\
+			__left = (condition) ? 1 : 0;								\
+			break;														\
+		}																\
+	}																	\
+	intr_set_status(__old);												\
+	(uint32_t)(__left > 0 ? __left : 0);								\
+})
+
+
+void rwsem_init(struct rw_semaphore* rwsem);
+
+void down_read(struct rw_semaphore* rwsem);
+
+void up_read(struct rw_semaphore* rwsem);
+
+void down_write(struct rw_semaphore* rwsem);
+
+void up_write(struct rw_semaphore* rwsem);
+
+
 #endif
\ No newline at end of file
@@ -8,11 +8,13 @@
 #include "memory.h"
 #include "process.h"
 #include "sync.h"
+#include "timer.h"
+#include "trace.h"
+#include "cpu.h"
 
 struct task_struct* main_thread;    // 主线程PCB
-struct task_struct* idle_thread;    // idle 线程
 
-struct list thread_ready_list;      // 就绪队列
+struct run_queue run_queues[NR_CPUS];   // 每个 cpu 的就绪队列
 struct list thread_all_list;        // 所有任务队列
 
 struct mutex_t pid_lock;
@@ -27,6 +29,21 @@ inline struct task_struct* running_thread() {
     return (struct task_struct*)(esp & 0xfffff000);
 }
 
+/** 把 pthread 在旧状态下度过的时间结算到对应的统计项，再切换到新状态 */
+static void task_set_status(struct task_struct* pthread, enum task_status stat) {
+    uint64_t now = rdtsc();
+    uint64_t delta = now - pthread->state_tsc;
+    if (pthread->status == TASK_RUNNING) {
+        pthread->run_tsc += delta;
+    } else if (pthread->status == TASK_READY) {
+        pthread->wait_tsc += delta;
+    } else {
+        pthread->block_tsc += delta;
+    }
+    pthread->state_tsc = now;
+    pthread->status = stat;
+}
+
 /* 由kernel_thread去执行function(func_arg) */
 static void kernel_thread(thread_func* function, void* func_arg) {
     /* 执行function前要开中断,避免后面的时钟中断被屏蔽,而无法调度其它线程 */
@@ -37,9 +54,20 @@ static void kernel_thread(thread_func* function, void* func_arg) {
     // SCHEDULE
     // 有专门的线程负责把 DIED TASK 从链表中移除；
     // 回收 kmemory。Linux 中好像直接做了 Cache，如 始终有65536个PCB
+    thread_exit(0);
+}
+
+/** 当前线程退出，唤醒等待它的线程，不再返回。PCB 由 join 它的线程回收 */
+void thread_exit(int32_t status) {
     intr_disable();
-    running_thread()->status = TASK_DIED;
+    struct task_struct* cur = running_thread();
+    cur->exit_status = status;
+    if (cur->joiner != NULL) {
+        thread_unblock(cur->joiner);
+    }
+    task_set_status(cur, TASK_DIED);
     schedule();
+    PANIC("thread_exit: should not be here\n");
 }
 
 static void idle(__attribute__((unused)) void* arg) {
@@ -58,11 +86,137 @@ static pid_t allocate_pid(void) {
     return next_pid;
 }
 
+/** 线程最近刚在 cpu 上跑过，cache 中还有它的数据，迁移代价大 */
+static bool task_cache_hot(struct task_struct* pthread) {
+    return pthread->elapsed_ticks != 0 && ticks - pthread->last_run_tick < CACHE_HOT_TICKS;
+}
+
+/** 加入所属 cpu 就绪队列的队尾 */
+void thread_ready_append(struct task_struct* pthread) {
+    struct run_queue* rq = task_rq(pthread);
+    ASSERT(!elem_find(&rq->ready_list, &pthread->general_tag));
+    list_append(&rq->ready_list, &pthread->general_tag);
+    rq->nr_ready++;
+}
+
+/** 加入所属 cpu 就绪队列的队首，被唤醒的线程优先上 cpu */
+static void thread_ready_push(struct task_struct* pthread) {
+    struct run_queue* rq = task_rq(pthread);
+    if (elem_find(&rq->ready_list, &pthread->general_tag)) {
+        PANIC("find blocked thread in ready list\n");
+    }
+    list_push(&rq->ready_list, &pthread->general_tag);
+    rq->nr_ready++;
+}
+
+/** 修改有效优先级，剩下的时间片随之增减。就绪的线程被抬高后移到队首，尽快上 cpu 释放它持有的锁；
+ * 时间片也要补上，否则被抬高的持锁线程用完原来剩下的一点时间片，仍要排到中优先级线程后面 */
+void thread_set_priority(struct task_struct* pthread, uint8_t prio) {
+    enum intr_status old_status = intr_disable();
+    bool raised = prio > pthread->priority;
+    if (raised) {
+        pthread->ticks += prio - pthread->priority;
+    } else if (pthread->ticks > prio) {
+        pthread->ticks = prio;
+    }
+    pthread->priority = prio;
+    if (raised && pthread->status == TASK_READY) {
+        list_remove(&pthread->general_tag);
+        list_push(&task_rq(pthread)->ready_list, &pthread->general_tag);
+    }
+    intr_set_status(old_status);
+}
+
+/** 从 rq 队尾起找一个可迁移的线程摘下，force 为 true 时忽略 cache 亲和 */
+static struct task_struct* rq_steal_tail(struct run_queue* rq, bool force) {
+    struct list_elem* elem = rq->ready_list.tail.prev;
+    while (elem != &rq->ready_list.head) {
+        struct task_struct* pthread = elem2entry(struct task_struct, general_tag, elem);
+        if (pthread != rq->idle && (force || !task_cache_hot(pthread))) {
+            list_remove(elem);
+            rq->nr_ready--;
+            return pthread;
+        }
+        elem = elem->prev;
+    }
+    return NULL;
+}
+
+/** 找出除 rq 外就绪线程最多的队列 */
+static struct run_queue* find_busiest_rq(struct run_queue* rq) {
+    struct run_queue* busiest = NULL;
+    for (uint8_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        struct run_queue* other = &run_queues[cpu];
+        if (other != rq && other->nr_ready > 0 && 
+            (busiest == NULL || other->nr_ready > busiest->nr_ready)) {
+            busiest = other;
+        }
+    }
+    return busiest;
+}
+
+/** 把 pthread 迁到 rq 所属的 cpu 上 */
+static void migrate_task(struct task_struct* pthread, struct run_queue* rq) {
+    pthread->cpu = rq - run_queues;
+    list_append(&rq->ready_list, &pthread->general_tag);
+    rq->nr_ready++;
+    rq->nr_steals++;
+}
+
+/** 本 cpu 即将空闲：从最忙的 cpu 队尾偷一个线程 */
+static bool idle_steal(struct run_queue* rq) {
+    struct run_queue* busiest = find_busiest_rq(rq);
+    if (busiest == NULL) {
+        return false;
+    }
+    // 宁可拿 cache 热的线程，也比让本 cpu 空转强
+    struct task_struct* pthread = rq_steal_tail(busiest, false);
+    if (pthread == NULL) {
+        pthread = rq_steal_tail(busiest, true);
+    }
+    if (pthread == NULL) {
+        return false;
+    }
+    migrate_task(pthread, rq);
+    return true;
+}
+
+/** 周期性负载均衡：本 cpu 比最忙的 cpu 少 2 个以上就绪线程时，拉过来一半差值 */
+static void load_balance(struct run_queue* rq) {
+    struct run_queue* busiest = find_busiest_rq(rq);
+    if (busiest == NULL || busiest->nr_ready <= rq->nr_ready + 1) {
+        return;
+    }
+    uint32_t nr_move = (busiest->nr_ready - rq->nr_ready) / 2;
+    while (nr_move-- > 0) {
+        struct task_struct* pthread = rq_steal_tail(busiest, false);
+        if (pthread == NULL) {  // 剩下的都是 cache 热的，下次再说
+            break;
+        }
+        migrate_task(pthread, rq);
+    }
+}
+
+/** 由时钟中断调用：统计 cpu 利用率，定期做负载均衡 */
+void sched_tick(void) {
+    struct run_queue* rq = this_rq();
+    if (running_thread() == rq->idle) {
+        rq->idle_ticks++;
+    } else {
+        rq->busy_ticks++;
+    }
+    if (ticks % BALANCE_INTERVAL == 0) {
+        load_balance(rq);
+    }
+}
+
 void thread_block(enum task_status stat) {
     // 3 status are allowed
     ASSERT(stat == TASK_BLOCKED || stat == TASK_WAITING || stat == TASK_HANGING);
     enum intr_status old_status = intr_disable();
-    running_thread()->status = stat;
+    struct task_struct* cur = running_thread();
+    sched_trace(SCHED_EV_BLOCK, cur->pid, stat);
+    task_set_status(cur, stat);
     schedule();
     intr_set_status(old_status);
 }
@@ -70,9 +224,8 @@ void thread_block(enum task_status stat) {
 void thread_yield() {
     struct task_struct* cur = running_thread();
     enum intr_status old_status = intr_disable();
-    ASSERT(!elem_find(&thread_ready_list, &cur->general_tag));
-    list_append(&thread_ready_list, &cur->general_tag);
-    cur->status = TASK_READY;
+    thread_ready_append(cur);
+    task_set_status(cur, TASK_READY);
     schedule();
     intr_set_status(old_status); 
 }
@@ -82,11 +235,12 @@ void thread_unblock(struct task_struct* pthread) {
     enum task_status p_stat = pthread->status;
     ASSERT(p_stat == TASK_HANGING || p_stat == TASK_WAITING || p_stat == TASK_BLOCKED);
     if (p_stat != TASK_READY) {
-        if (elem_find(&thread_ready_list, &pthread->general_tag)) {
-            PANIC("find blocked thread in ready list\n");
-        }
-        list_push(&thread_ready_list, &pthread->general_tag);
-        pthread->status = TASK_READY;
+        // 在超时之前被正常唤醒，撤掉定时器
+        timer_disarm(pthread);
+        pthread->wait_list = NULL;
+        thread_ready_push(pthread);
+        sched_trace(SCHED_EV_WAKE, pthread->pid, running_thread()->pid);
+        task_set_status(pthread, TASK_READY);
     } 
     intr_set_status(old_status); 
 }
@@ -110,11 +264,19 @@ void init_thread(struct task_struct* pthread, char* name, int prio) {
     strcpy(pthread->name, name);
       
     pthread->self_kstack = (uint32_t*)((uint32_t)pthread + PG_SIZE); // 内核栈顶在页表顶部
-    // TODO: - 一个进程一个 pid 啊，需要修改（配合那个用户进程里的多线程）
+    // 下面 allocate_pid 会加锁，main 线程此时就是 running_thread，需先初始化持锁队列
+    list_init(&pthread->held_mutexes);
+    list_init(&pthread->vm_areas);
+    pthread->blocked_on = NULL;
+    pthread->wait_list = NULL;
+    // 线程各自有 pid，同一进程的线程通过 leader 共用地址空间，进程号取 leader 的 pid
     pthread->pid = allocate_pid();
+    pthread->leader = pthread;
     pthread->priority = prio;
+    pthread->base_priority = prio;
     pthread->ticks = prio;
     pthread->elapsed_ticks = 0;
+    pthread->cpu = cpu_id();
     pthread->pgdir = NULL;
 
     pthread->fd_table[0] = 0;
@@ -126,6 +288,8 @@ void init_thread(struct task_struct* pthread, char* name, int prio) {
     
     pthread->stack_magic = 0x19870916;  // 自定义的魔数
 
+    pthread->state_tsc = rdtsc();
+
     pthread->status = TASK_READY;
     if (pthread == main_thread) {
         pthread->status = TASK_RUNNING; // main 线程一直是运行的
@@ -140,10 +304,8 @@ struct task_struct* thread_start(char* name, int prio, thread_func function, voi
     init_thread(thread, name, prio);
     thread_create(thread, function, func_arg);
     
-    /* 确保之前不在队列中 */
-    ASSERT(!elem_find(&thread_ready_list, &thread->general_tag));
-    /* 加入就绪线程队列 */
-    list_append(&thread_ready_list, &thread->general_tag);
+    /* 加入当前 cpu 的就绪队列，空闲的 cpu 会把它偷走 */
+    thread_ready_append(thread);
     
     /* 确保之前不在队列中 */
     ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
@@ -160,14 +322,23 @@ static void make_main_thread(void) {
     main_thread = running_thread();
     init_thread(main_thread, "main", 31);
     
-    /* main函数是当前线程,当前线程不在thread_ready_list中,
+    /* main函数是当前线程,当前线程不在就绪队列中,
      * 所以只将其加在thread_all_list中. */
     ASSERT(!elem_find(&thread_all_list, &main_thread->all_list_tag));
     list_append(&thread_all_list, &main_thread->all_list_tag);
 }
 
+/** 每个 cpu 一个 idle 线程，它只在自己的 cpu 上运行，不参与迁移 */
 static void make_idle_thread(void) {
-    idle_thread = thread_start("idle", 10, idle, NULL); 
+    for (uint8_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        struct task_struct* idle_thread = get_pages(1, PF_KERNEL);
+        init_thread(idle_thread, "idle", 10);
+        thread_create(idle_thread, idle, NULL);
+        idle_thread->cpu = cpu;
+        run_queues[cpu].idle = idle_thread;
+        thread_ready_append(idle_thread);
+        list_append(&thread_all_list, &idle_thread->all_list_tag);
+    }
 }
 
 static struct list_elem* thread_tag; // temp container
@@ -178,25 +349,34 @@ void schedule() {
     ASSERT(intr_get_status() == INTR_OFF);
 
     struct task_struct* cur = running_thread();
+    struct run_queue* rq = this_rq();
+    cur->last_run_tick = ticks;
     if (cur->status == TASK_RUNNING) { // 若此线程只是cpu时间片到了,将其加入到就绪队列尾
-        ASSERT(!elem_find(&thread_ready_list, &cur->general_tag));
-        list_append(&thread_ready_list, &cur->general_tag);
+        thread_ready_append(cur);
         cur->ticks = cur->priority;     // 重新将当前线程的ticks再重置为其priority;
-        cur->status = TASK_READY;
+        task_set_status(cur, TASK_READY);
     } else {
         /* 若此线程需要某事件发生后才能继续上cpu运行,
          不需要将其加入队列,因为当前线程不在就绪队列中。*/
     }
 
-    if (list_empty(&thread_ready_list)) {
-        thread_unblock(idle_thread);
+    /* 本 cpu 无事可做时先去别的 cpu 偷，偷不到再运行 idle */
+    if (list_empty(&rq->ready_list) && !idle_steal(rq)) {
+        thread_unblock(rq->idle);
     }
 
-    /* 将thread_ready_list队列中的第一个就绪线程弹出,准备将其调度上cpu. */
-    thread_tag = list_pop(&thread_ready_list);
+    /* 将就绪队列中的第一个就绪线程弹出,准备将其调度上cpu. */
+    thread_tag = list_pop(&rq->ready_list);
+    rq->nr_ready--;
     struct task_struct* next = elem2entry(struct task_struct, general_tag, thread_tag);
-    next->status = TASK_RUNNING;
+    task_set_status(next, TASK_RUNNING);
+    if (next == cur) {      // 又选中了自己，不必切换
+        return;
+    }
+    cur->nr_switches++;
+    sched_trace(SCHED_EV_SWITCH, cur->pid, next->pid);
     process_activate(next);
+    fpu_switch(cur, next);
 
     switch_to(cur, next);
 }
@@ -205,7 +385,10 @@ void schedule() {
 void thread_init(void) {
     put_str("   thread_init start...\n");
 
-    list_init(&thread_ready_list);
+    for (uint8_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        memset(&run_queues[cpu], 0, sizeof(struct run_queue));
+        list_init(&run_queues[cpu].ready_list);
+    }
     list_init(&thread_all_list);
     mutex_init(&pid_lock);
 
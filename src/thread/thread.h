@@ -2,9 +2,14 @@
 #define __THREAD_THREAD_H
 #include "memory.h"
 #include "list.h"
+#include "fpu.h"
 
 #define MAX_FILES_OPEN_PER_PROC 8
 
+#define NR_CPUS             1   // 处理器个数，目前只有 cpu0，每个 cpu 一个就绪队列
+#define BALANCE_INTERVAL    10  // 每隔多少嘀嗒做一次周期性负载均衡
+#define CACHE_HOT_TICKS     2   // 刚下 cpu 不足此嘀嗒数的线程认为 cache 仍热，尽量不迁移
+
 /* 自定义通用函数类型,它将在很多线程函数中做为形参类型 */
 typedef void thread_func(void*);
 typedef int16_t pid_t;
@@ -77,30 +82,75 @@ struct thread_stack {
 struct task_struct {
     uint32_t*           self_kstack;    // 各线程都有自己的内核栈
 
-    pid_t               pid;
+    pid_t               pid;            // 线程号，每个线程各不相同
+    struct task_struct* leader;         // 所属进程的主线程，进程和内核线程的 leader 是自己
     enum task_status    status;
-    uint8_t             priority;       // 线程优先级，目前表现为嘀嗒数
+    uint8_t             priority;       // 有效优先级，目前表现为嘀嗒数；持锁时可能被等待者抬高
+    uint8_t             base_priority;  // 创建时设定的优先级，优先级继承结束后恢复到它
     char                name[16];          
     
     uint8_t             ticks;  
     uint32_t            elapsed_ticks;  // 此任务自上cpu运行后至今占用了多少cpu嘀嗒数,
+    uint32_t            last_run_tick;  // 最近一次下 cpu 时的全局 ticks，用于判断 cache 亲和
+    uint8_t             cpu;            // 所在就绪队列属于哪个 cpu
+
+    uint64_t            run_tsc;        // 以 tsc 周期计的运行时间
+    uint64_t            wait_tsc;       // 在就绪队列中等待的时间
+    uint64_t            block_tsc;      // 阻塞的时间
+    uint64_t            state_tsc;      // 进入当前状态的时刻，状态改变时结算到上面三项
+    uint32_t            nr_switches;    // 被换下 cpu 的次数
+
+    struct list*        wait_list;      // 带超时阻塞时所在的等待队列，超时唤醒时要从中摘除
+    uint32_t            wakeup_tick;    // 超时的时刻
+    bool                timed_out;      // 上次带超时的阻塞是否因超时而醒
+    struct list_elem    timer_tag;      // 定时器超时队列中的结点
+
+    struct list         held_mutexes;   // 本线程持有的锁，用于计算继承来的优先级
+    struct mutex_t*     blocked_on;     // 正在等待的锁，优先级沿它的持有者链传递
          
     int32_t             fd_table[MAX_FILES_OPEN_PER_PROC];    
-                                        // 文件描述符数组
-    struct list_elem    general_tag;    // 线程队列 thread_ready_list 中的结点
+                                        // 文件描述符数组，进程内的线程共用 leader 的
+    struct list_elem    general_tag;    // 就绪队列 run_queue.ready_list 或等待队列中的结点
     struct list_elem    all_list_tag;   // 线程队列 thread_all_list 中的结点 
     
-    uint32_t*           pgdir;          // 进程自己页表的虚拟地址
-    struct virtual_addr userprog_vaddr; // 用户进程也要维护自己的堆内存
+    uint32_t*           pgdir;          // 进程自己页表的虚拟地址，进程内的线程与 leader 相同
+    struct virtual_addr userprog_vaddr; // 用户进程也要维护自己的堆内存，线程用 leader 的
 
     struct mem_block_desc u_block_desc[DESC_CNT];
-                                        // 用户进程内存块描述符
+                                        // 用户进程内存块描述符，线程用 leader 的
+    void*               ustack;         // 用户线程自己的 3 级栈页，join 时释放
+    struct task_struct* joiner;         // 等待本线程退出的线程
+    int32_t             exit_status;    // 退出码，由 join 取走
+    struct sring_ctx*   ring;           // 进程的批量提交环，线程用 leader 的
+    struct list         vm_areas;       // 按需从文件加载的用户地址区间，线程用 leader 的
+    bool                fpu_used;       // 是否用过 FPU，没用过的第一次要 fninit 而不是恢复
+    union fpu_state     fpu_state;      // FPU/SSE 上下文，只在被别的线程抢走 FPU 时才保存到这里
     uint32_t            stack_magic;    // 栈的边界标记 用于检测栈的溢出
 };
 
-extern struct list thread_ready_list;
+/* 每个 cpu 的就绪队列。本 cpu 从队首取任务，空闲的 cpu 从别的队列队尾窃取 */
+struct run_queue {
+    struct list         ready_list;     // 就绪线程
+    uint32_t            nr_ready;       // ready_list 的长度，负载均衡时比较用
+    uint32_t            busy_ticks;     // 非 idle 线程占用的嘀嗒数
+    uint32_t            idle_ticks;     // idle 线程占用的嘀嗒数，与上项一起算利用率
+    uint32_t            nr_steals;      // 从其它 cpu 窃取的线程数
+    struct task_struct* idle;           // 本 cpu 的 idle 线程
+    uint32_t*           active_pgdir;   // cr3 中装载的页表，NULL 为内核页表。内核线程沿用它而不切换
+    uint32_t            nr_cr3_loads;   // 实际写 cr3 的次数
+};
+
+extern struct run_queue run_queues[NR_CPUS];
 extern struct list thread_all_list;
 
+/* 当前 cpu 编号。单处理器下恒为 0，SMP 时应读 local APIC id */
+static inline uint8_t cpu_id(void) {
+    return 0;
+}
+
+#define this_rq() (&run_queues[cpu_id()])
+#define task_rq(pthread) (&run_queues[(pthread)->cpu])
+
 void schedule(void);
 struct task_struct* running_thread(void);
 
@@ -112,6 +162,11 @@ void thread_init(void);
 void thread_yield(void);
 void thread_block(enum task_status stat);
 void thread_unblock(struct task_struct* pthread); 
+void thread_exit(int32_t status);
+
+void thread_ready_append(struct task_struct* pthread);
+void thread_set_priority(struct task_struct* pthread, uint8_t prio);
+void sched_tick(void);
 
 #endif
 
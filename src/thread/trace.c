@@ -0,0 +1,87 @@
+#include "trace.h"
+#include "interrupt.h"
+#include "stdio-kernel.h"
+#include "timer.h"
+#include "cpu.h"
+
+/* 调度事件环形缓冲区，满了覆盖最旧的。只在关中断下写入 */
+static struct sched_event sched_events[SCHED_TRACE_SIZE];
+static uint32_t sched_event_cnt;    // 总共记录过的事件数，对容量取模即下一个写入位置
+
+static const char* task_status_name[] = {
+    "RUNNING", "READY", "BLOCKED", "WAITING", "HANGING", "DIED"
+};
+
+static const char* sched_event_name[] = {
+    "switch", "wake", "block"
+};
+
+/** 记录一条调度事件，由 schedule、thread_block、thread_unblock 在关中断下调用 */
+void sched_trace(enum sched_event_type type, pid_t pid, int16_t arg) {
+    struct sched_event* ev = &sched_events[sched_event_cnt++ & (SCHED_TRACE_SIZE - 1)];
+    ev->tsc  = rdtsc();
+    ev->type = type;
+    ev->cpu  = cpu_id();
+    ev->pid  = pid;
+    ev->arg  = arg;
+}
+
+/** 打印每个线程的运行、就绪等待、阻塞时间(微秒)及被切换次数 */
+static void dump_threads(void) {
+    printk("PID NAME STAT PRIO SWITCHES RUN_US WAIT_US BLOCK_US\n");
+    struct list_elem* elem = thread_all_list.head.next;
+    while (elem != &thread_all_list.tail) {
+        /* 关中断拍一份快照，打印时要拿控制台锁，不能关着中断 */
+        enum intr_status old_status = intr_disable();
+        struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, elem);
+        pid_t pid = pthread->pid;
+        enum task_status status = pthread->status;
+        uint8_t priority = pthread->priority;
+        uint32_t nr_switches = pthread->nr_switches;
+        uint64_t run = pthread->run_tsc, wait = pthread->wait_tsc, block = pthread->block_tsc;
+        uint64_t in_state = rdtsc() - pthread->state_tsc;    // 还没结算的当前状态时长
+        if (status == TASK_RUNNING) {
+            run += in_state;
+        } else if (status == TASK_READY) {
+            wait += in_state;
+        } else {
+            block += in_state;
+        }
+        elem = elem->next;
+        intr_set_status(old_status);
+
+        printk("%d %s %s %d %d %d %d %d\n", pid, pthread->name, task_status_name[status],
+            priority, nr_switches, tsc_to_us(run), tsc_to_us(wait), tsc_to_us(block));
+    }
+}
+
+/** 打印最近 nr_events 条调度事件，时刻为相对最后一条的微秒数 */
+static void dump_events(uint32_t nr_events) {
+    enum intr_status old_status = intr_disable();
+    uint32_t end = sched_event_cnt;
+    intr_set_status(old_status);
+    if (nr_events > SCHED_TRACE_SIZE) {
+        nr_events = SCHED_TRACE_SIZE;
+    }
+    if (nr_events > end) {
+        nr_events = end;
+    }
+    if (nr_events == 0) {
+        return;
+    }
+    uint64_t last_tsc = sched_events[(end - 1) & (SCHED_TRACE_SIZE - 1)].tsc;
+    printk("last %d sched events (us before the newest):\n", nr_events);
+    for (uint32_t idx = end - nr_events; idx != end; idx++) {
+        old_status = intr_disable();
+        struct sched_event ev = sched_events[idx & (SCHED_TRACE_SIZE - 1)];
+        intr_set_status(old_status);
+        printk("  -%d cpu%d %s pid %d arg %d\n", tsc_to_us(last_tsc - ev.tsc),
+            ev.cpu, sched_event_name[ev.type], ev.pid, ev.arg);
+    }
+}
+
+/** ps 系统调用：列出所有线程的 cpu 时间统计，再附上最近 nr_events 条调度事件 */
+void sys_ps(uint32_t nr_events) {
+    dump_threads();
+    dump_events(nr_events);
+}
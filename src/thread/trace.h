@@ -0,0 +1,27 @@
+#ifndef __THREAD_TRACE_H
+#define __THREAD_TRACE_H
+#include "stdint.h"
+#include "thread.h"
+
+#define SCHED_TRACE_SIZE    256     // 事件环形缓冲区的容量，须为 2 的幂
+
+/* 调度事件类型 */
+enum sched_event_type {
+    SCHED_EV_SWITCH,    // pid 下 cpu，arg 为接着上 cpu 的 pid
+    SCHED_EV_WAKE,      // pid 被唤醒，arg 为唤醒者的 pid
+    SCHED_EV_BLOCK      // pid 阻塞，arg 为阻塞后的状态
+};
+
+/* 一条调度事件 */
+struct sched_event {
+    uint64_t tsc;       // 发生时刻
+    uint8_t  type;      // enum sched_event_type
+    uint8_t  cpu;
+    pid_t    pid;
+    int16_t  arg;
+};
+
+void sched_trace(enum sched_event_type type, pid_t pid, int16_t arg);
+void sys_ps(uint32_t nr_events);
+
+#endif
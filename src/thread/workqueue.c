@@ -0,0 +1,170 @@
+#include "workqueue.h"
+#include "thread.h"
+#include "sync.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "debug.h"
+#include "print.h"
+
+/* 一个 kworker。current 为正在执行的工作，delegated 为执行期间又被排队、转交给它的同一批工作 */
+struct worker {
+    struct task_struct* thread;
+    struct work_struct* current;
+    struct list delegated;
+};
+
+static struct worker workers[NR_WORKERS];
+static struct list work_list;           // 待执行的工作，先进先出
+static struct list delayed_list;        // 延迟工作，按到期时刻升序排列
+static struct wait_queue worker_wait;   // 空闲的 worker 睡在这里
+static struct wait_queue flush_wait;    // flush_work 的调用者睡在这里
+
+void work_init(struct work_struct* work, work_func* func, void* arg) {
+    work->func = func;
+    work->arg = arg;
+    work->pending = false;
+}
+
+void delayed_work_init(struct delayed_work* dwork, work_func* func, void* arg) {
+    work_init(&dwork->work, func, arg);
+    dwork->timer_pending = false;
+}
+
+/** 排队 work，已在排队中则什么也不做并返回 false。可在中断处理程序中调用 */
+bool queue_work(struct work_struct* work) {
+    enum intr_status old_status = intr_disable();
+    if (work->pending) {
+        intr_set_status(old_status);
+        return false;
+    }
+    work->pending = true;
+    list_append(&work_list, &work->entry);
+    wake_up(&worker_wait);
+    intr_set_status(old_status);
+    return true;
+}
+
+/** delay 个嘀嗒后排队 dwork，已在等待或排队中则返回 false */
+bool queue_delayed_work(struct delayed_work* dwork, uint32_t delay) {
+    if (delay == 0) {
+        return queue_work(&dwork->work);
+    }
+    enum intr_status old_status = intr_disable();
+    if (dwork->timer_pending || dwork->work.pending) {
+        intr_set_status(old_status);
+        return false;
+    }
+    dwork->timer_pending = true;
+    dwork->expires = ticks + delay;
+    struct list_elem* elem = delayed_list.head.next;
+    while (elem != &delayed_list.tail) {
+        struct delayed_work* other = elem2entry(struct delayed_work, timer_tag, elem);
+        if ((int32_t)(dwork->expires - other->expires) < 0) {
+            break;
+        }
+        elem = elem->next;
+    }
+    list_insert_before(elem, &dwork->timer_tag);
+    intr_set_status(old_status);
+    return true;
+}
+
+/** 时钟中断调用：把到期的延迟工作移入工作队列 */
+void workqueue_tick(void) {
+    while (!list_empty(&delayed_list)) {
+        struct delayed_work* dwork = elem2entry(struct delayed_work, timer_tag, delayed_list.head.next);
+        if ((int32_t)(ticks - dwork->expires) < 0) {
+            break;
+        }
+        list_remove(&dwork->timer_tag);
+        dwork->timer_pending = false;
+        queue_work(&dwork->work);
+    }
+}
+
+/** 是否有 worker 正在执行 work */
+static struct worker* find_worker_running(struct work_struct* work) {
+    for (uint8_t idx = 0; idx < NR_WORKERS; idx++) {
+        if (workers[idx].current == work) {
+            return &workers[idx];
+        }
+    }
+    return NULL;
+}
+
+/** 等待 work 执行完，返回时它既不在排队也不在执行 */
+void flush_work(struct work_struct* work) {
+    enum intr_status old_status = intr_disable();
+    while (work->pending || find_worker_running(work) != NULL) {
+        wait_queue_sleep(&flush_wait, 0);
+    }
+    intr_set_status(old_status);
+}
+
+/** 不再等待延迟，立即排队 dwork 并等它执行完 */
+void flush_delayed_work(struct delayed_work* dwork) {
+    enum intr_status old_status = intr_disable();
+    if (dwork->timer_pending) {
+        list_remove(&dwork->timer_tag);
+        dwork->timer_pending = false;
+        queue_work(&dwork->work);
+    }
+    intr_set_status(old_status);
+    flush_work(&dwork->work);
+}
+
+/** 取下一项要执行的工作，优先执行转交给自己的。需在关中断下调用 */
+static struct work_struct* worker_next(struct worker* self) {
+    while (1) {
+        if (!list_empty(&self->delegated)) {
+            return elem2entry(struct work_struct, entry, list_pop(&self->delegated));
+        }
+        if (list_empty(&work_list)) {
+            return NULL;
+        }
+        struct work_struct* work = elem2entry(struct work_struct, entry, list_pop(&work_list));
+        struct worker* owner = find_worker_running(work);
+        if (owner == NULL) {
+            return work;
+        }
+        // 别的 worker 正在执行它，交给那个 worker 执行完后接着执行，保证不会并发
+        list_append(&owner->delegated, &work->entry);
+    }
+}
+
+/** kworker 主循环。执行完 work 后不再访问它，work 可以在自己的 func 中释放 */
+static void worker_thread(void* arg) {
+    struct worker* self = arg;
+    intr_disable();
+    while (1) {
+        struct work_struct* work = worker_next(self);
+        if (work == NULL) {
+            wait_queue_sleep(&worker_wait, 0);
+            continue;
+        }
+        work->pending = false;
+        self->current = work;
+        work_func* func = work->func;
+        void* func_arg = work->arg;
+        intr_enable();
+        func(func_arg);
+        intr_disable();
+        self->current = NULL;
+        wake_up_all(&flush_wait);
+    }
+}
+
+/** 创建工作线程池 */
+void workqueue_init(void) {
+    put_str("   workqueue_init start...\n");
+    list_init(&work_list);
+    list_init(&delayed_list);
+    wait_queue_init(&worker_wait);
+    wait_queue_init(&flush_wait);
+    for (uint8_t idx = 0; idx < NR_WORKERS; idx++) {
+        workers[idx].current = NULL;
+        list_init(&workers[idx].delegated);
+        workers[idx].thread = thread_start("kworker", WORKER_PRIO, worker_thread, &workers[idx]);
+    }
+    put_str("   workqueue_init done!\n");
+}
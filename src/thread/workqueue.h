@@ -0,0 +1,38 @@
+#ifndef __THREAD_WORKQUEUE_H
+#define __THREAD_WORKQUEUE_H
+#include "stdint.h"
+#include "list.h"
+
+#define NR_WORKERS      2       // 工作线程池中 kworker 的个数
+#define WORKER_PRIO     31      // kworker 的优先级
+
+typedef void work_func(void* arg);
+
+/* 一项推迟执行的工作。同一项工作不会被两个 worker 同时执行 */
+struct work_struct {
+    struct list_elem entry;     // 工作队列中的结点
+    work_func* func;
+    void* arg;
+    bool pending;               // 已排队尚未开始执行
+};
+
+/* 延迟 delay 个嘀嗒后才排队的工作，由时钟中断驱动 */
+struct delayed_work {
+    struct work_struct work;
+    struct list_elem timer_tag; // 延迟队列中的结点
+    uint32_t expires;           // 到期的嘀嗒数
+    bool timer_pending;         // 是否在延迟队列中
+};
+
+void workqueue_init(void);
+void work_init(struct work_struct* work, work_func* func, void* arg);
+void delayed_work_init(struct delayed_work* dwork, work_func* func, void* arg);
+
+bool queue_work(struct work_struct* work);
+bool queue_delayed_work(struct delayed_work* dwork, uint32_t delay);
+void flush_work(struct work_struct* work);
+void flush_delayed_work(struct delayed_work* dwork);
+
+void workqueue_tick(void);
+
+#endif
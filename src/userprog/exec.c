@@ -0,0 +1,358 @@
+#include "exec.h"
+#include "thread.h"
+#include "process.h"
+#include "memory.h"
+#include "fs.h"
+#include "file.h"
+#include "inode.h"
+#include "uaccess.h"
+#include "interrupt.h"
+#include "string.h"
+#include "global.h"
+#include "debug.h"
+
+extern void intr_exit(void);
+
+#define EXEC_MAX_ARGS   16          // argv 最多几项
+#define EXEC_ARG_BYTES  1024        // argv 字符串总长上限，含各自结尾的 '\0'
+#define EXEC_MAX_PHNUM  16          // 程序头最多几项
+
+typedef uint32_t Elf32_Word, Elf32_Addr, Elf32_Off;
+typedef uint16_t Elf32_Half;
+
+/* ELF 文件头 */
+struct Elf32_Ehdr {
+    unsigned char e_ident[16];
+    Elf32_Half    e_type;
+    Elf32_Half    e_machine;
+    Elf32_Word    e_version;
+    Elf32_Addr    e_entry;
+    Elf32_Off     e_phoff;
+    Elf32_Off     e_shoff;
+    Elf32_Word    e_flags;
+    Elf32_Half    e_ehsize;
+    Elf32_Half    e_phentsize;
+    Elf32_Half    e_phnum;
+    Elf32_Half    e_shentsize;
+    Elf32_Half    e_shnum;
+    Elf32_Half    e_shstrndx;
+};
+
+/* 程序头，描述一个段 */
+struct Elf32_Phdr {
+    Elf32_Word p_type;
+    Elf32_Off  p_offset;
+    Elf32_Addr p_vaddr;
+    Elf32_Addr p_paddr;
+    Elf32_Word p_filesz;
+    Elf32_Word p_memsz;
+    Elf32_Word p_flags;
+    Elf32_Word p_align;
+};
+
+#define PT_LOAD 1       // 可加载的段
+#define ET_EXEC 2       // 可执行文件
+#define EM_386  3       // intel 80386
+
+/** vaddr 所在的页是否已映射 */
+static bool page_present(uint32_t vaddr) {
+    return (*pde_ptr(vaddr) & PG_P_1) && (*pte_ptr(vaddr) & PG_P_1);
+}
+
+/** 进程中包含 vaddr 的区间 */
+static struct vm_area* vma_find(struct task_struct* leader, uint32_t vaddr) {
+    struct list_elem* elem = leader->vm_areas.head.next;
+    while (elem != &leader->vm_areas.tail) {
+        struct vm_area* vma = elem2entry(struct vm_area, tag, elem);
+        if (vaddr >= vma->start && vaddr < vma->end) {
+            return vma;
+        }
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/** 用户地址 vaddr 缺页时调用，需开中断。属于某个区间则从文件读入该页并映射，返回 true；
+ * 不属于任何区间或内存不足返回 false，由缺页处理按一般异常处理 */
+bool vma_fault(uint32_t vaddr) {
+    struct vm_area* vma = vma_find(running_thread()->leader, vaddr);
+    if (vma == NULL) {
+        return false;
+    }
+    uint32_t page = vaddr & 0xfffff000;
+    uint8_t* buf = get_pages(1, PF_KERNEL);
+    if (buf == NULL) {
+        return false;
+    }
+    uint32_t rel = page - vma->start;
+    uint32_t from_file = 0;
+    if (rel < vma->file_bytes) {
+        from_file = vma->file_bytes - rel < PG_SIZE ? vma->file_bytes - rel : PG_SIZE;
+    }
+    bool ok = from_file == 0 ||
+              file_read_at(vma->inode, vma->file_off + rel, buf, from_file) == (int32_t)from_file;
+    // 先读进内核缓冲区，读盘期间同进程的其它线程可能已经装好这一页。
+    // 检查、映射、填充之间关中断，别的线程看不到没填好的页
+    if (ok) {
+        enum intr_status old_status = intr_disable();
+        if (!page_present(page)) {
+            ok = get_one_page(PF_USER, page) != NULL;
+            if (ok) {
+                memcpy((void*)page, buf, PG_SIZE);   // get_pages 已清零，from_file 之后即 .bss
+            }
+        }
+        intr_set_status(old_status);
+    }
+    free_pages(buf, 1, PF_KERNEL);
+    return ok;
+}
+
+/** 释放区间链表，关闭各区间的文件 */
+static void vma_release_all(struct list* vm_areas) {
+    while (!list_empty(vm_areas)) {
+        struct vm_area* vma = elem2entry(struct vm_area, tag, list_pop(vm_areas));
+        inode_close(vma->inode);
+        kfree(vma);
+    }
+}
+
+/** 读 ELF 头和程序头，为每个 PT_LOAD 段建立区间挂到 vm_areas 上，不读段内容。
+ * 成功返回 0 并由 entry 带回入口地址，文件不合法返回 -1 */
+static int32_t load_elf(struct inode* inode, struct list* vm_areas, uint32_t* entry) {
+    struct Elf32_Ehdr ehdr;
+    if (file_read_at(inode, 0, &ehdr, sizeof(ehdr)) != sizeof(ehdr) ||
+        memcmp(ehdr.e_ident, "\177ELF\1\1\1", 7) != 0 ||
+        ehdr.e_type != ET_EXEC || ehdr.e_machine != EM_386 || ehdr.e_version != 1 ||
+        ehdr.e_phentsize != sizeof(struct Elf32_Phdr) || 
+        ehdr.e_phnum == 0 || ehdr.e_phnum > EXEC_MAX_PHNUM) {
+        return -1;
+    }
+    uint32_t ph_size = ehdr.e_phnum * sizeof(struct Elf32_Phdr);
+    struct Elf32_Phdr* phdrs = kmalloc(ph_size);
+    if (phdrs == NULL) {
+        return -1;
+    }
+    if (file_read_at(inode, ehdr.e_phoff, phdrs, ph_size) != (int32_t)ph_size) {
+        kfree(phdrs);
+        return -1;
+    }
+
+    int32_t ret = 0;
+    for (uint32_t i = 0; i < ehdr.e_phnum && ret == 0; i++) {
+        struct Elf32_Phdr* ph = &phdrs[i];
+        if (ph->p_type != PT_LOAD || ph->p_memsz == 0) {
+            continue;
+        }
+        uint32_t start = ph->p_vaddr & 0xfffff000;
+        uint32_t end = ph->p_vaddr + ph->p_memsz;
+        uint32_t page_off = ph->p_vaddr & 0xfff;
+        // 段必须落在栈页以下的用户空间，文件偏移与地址页内对齐，内容不超出文件
+        if (ph->p_filesz > ph->p_memsz || page_off != (ph->p_offset & 0xfff) ||
+            start < USER_VADDR_START || end < ph->p_vaddr || end > USER_STACK3_VADDR ||
+            ph->p_offset + ph->p_filesz > inode->i_size) {
+            ret = -1;
+            break;
+        }
+        end = (end + PG_SIZE - 1) & 0xfffff000;
+        // 缺页时按页查区间，两个段共用一页就分不清该读哪段，不支持
+        struct list_elem* elem = vm_areas->head.next;
+        while (elem != &vm_areas->tail) {
+            struct vm_area* other = elem2entry(struct vm_area, tag, elem);
+            if (start < other->end && other->start < end) {
+                ret = -1;
+            }
+            elem = elem->next;
+        }
+        if (ret != 0) {
+            break;
+        }
+        struct vm_area* vma = kmalloc(sizeof(struct vm_area));
+        if (vma == NULL) {
+            ret = -1;
+            break;
+        }
+        vma->start = start;
+        vma->end = end;
+        vma->inode = inode_open(cur_part, inode->i_no);
+        vma->file_off = ph->p_offset - page_off;
+        vma->file_bytes = ph->p_filesz + page_off;
+        list_append(vm_areas, &vma->tag);
+    }
+    kfree(phdrs);
+    if (ret != 0 || list_empty(vm_areas)) {
+        vma_release_all(vm_areas);
+        return -1;
+    }
+    *entry = ehdr.e_entry;
+    return 0;
+}
+
+/** 把用户的 argv 依次复制到 buf，各串以 '\0' 隔开。返回 argc，过多过长或地址非法返回 -1 */
+static int32_t copy_args(char* const argv[], char* buf, uint32_t* bytes) {
+    int32_t argc = 0;
+    uint32_t used = 0;
+    while (argv != NULL) {
+        char* arg;
+        if (copy_from_user(&arg, &argv[argc], sizeof(arg)) != 0) {
+            return -1;
+        }
+        if (arg == NULL) {
+            break;
+        }
+        if (argc == EXEC_MAX_ARGS) {
+            return -1;
+        }
+        int32_t len = strncpy_from_user(buf + used, arg, EXEC_ARG_BYTES - used);
+        if (len < 0 || (uint32_t)len == EXEC_ARG_BYTES - used) {
+            return -1;
+        }
+        used += len + 1;
+        argc++;
+    }
+    *bytes = used;
+    return argc;
+}
+
+/** 进程中除了 cur 还有没有别的线程，包括已退出未回收的 */
+static bool has_other_threads(struct task_struct* cur) {
+    struct list_elem* elem = thread_all_list.head.next;
+    while (elem != &thread_all_list.tail) {
+        struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, elem);
+        if (pthread != cur && pthread->leader == cur) {
+            return true;
+        }
+        elem = elem->next;
+    }
+    return false;
+}
+
+/** 释放进程除栈页外的全部用户页：堆、已装入的段。未装入的区间只有位图占位，一并清除 */
+static void user_space_release(struct task_struct* leader) {
+    struct virtual_addr* uvaddr = &leader->userprog_vaddr;
+    struct bitmap* btmp = &uvaddr->vaddr_bitmap;
+    for (uint32_t byte_idx = 0; byte_idx < btmp->btmp_bytes_len; byte_idx++) {
+        if (btmp->bits[byte_idx] == 0) {
+            continue;
+        }
+        for (uint32_t bit_idx = byte_idx * 8; bit_idx < byte_idx * 8 + 8; bit_idx++) {
+            uint32_t vaddr = uvaddr->vaddr_start + bit_idx * PG_SIZE;
+            if (!bitmap_scan_test(btmp, bit_idx) || vaddr == USER_STACK3_VADDR) {
+                continue;
+            }
+            if (page_present(vaddr)) {
+                free_pages((void*)vaddr, 1, PF_USER);
+            } else {
+                bitmap_set(btmp, bit_idx, 0);
+            }
+        }
+    }
+    block_desc_init(leader->u_block_desc);
+}
+
+/** 在位图中占住区间的地址，堆不会分到这里 */
+static void vma_reserve(struct task_struct* leader, struct vm_area* vma) {
+    struct virtual_addr* uvaddr = &leader->userprog_vaddr;
+    for (uint32_t vaddr = vma->start; vaddr < vma->end; vaddr += PG_SIZE) {
+        bitmap_set(&uvaddr->vaddr_bitmap, (vaddr - uvaddr->vaddr_start) / PG_SIZE, 1);
+    }
+}
+
+/** 用 path 处的 ELF 可执行文件替换当前进程的映像，argv 以 NULL 结尾(可为 NULL)。
+ * 只建立各段的区间，段内容在第一次访问缺页时才从文件读入。
+ * 成功不返回，从新映像的入口以 entry(argc, argv) 的形式开始执行；失败返回 -1，原映像不受影响。
+ * 进程中还有别的线程(包括提交环的轮询线程)时不能 exec */
+int32_t sys_execv(const char* path, char* const argv[]) {
+    struct task_struct* cur = running_thread();
+    if (cur->pgdir == NULL || cur != cur->leader) {
+        return -1;
+    }
+    enum intr_status old_status = intr_disable();
+    bool busy = has_other_threads(cur);
+    intr_set_status(old_status);
+    if (busy) {
+        return -1;
+    }
+
+    // 路径和参数先复制进内核，旧映像释放之后就读不到了
+    char* kpath = kmalloc(MAX_PATH_LEN);
+    char* args = kmalloc(EXEC_ARG_BYTES);
+    if (kpath == NULL || args == NULL) {
+        goto fail;
+    }
+    int32_t len = strncpy_from_user(kpath, path, MAX_PATH_LEN);
+    uint32_t arg_bytes;
+    int32_t argc = copy_args(argv, args, &arg_bytes);
+    if (len <= 0 || len == MAX_PATH_LEN || argc < 0) {
+        goto fail;
+    }
+
+    int32_t fd = sys_open(kpath, O_RDONLY);
+    if (fd == -1) {
+        goto fail;
+    }
+    struct list vm_areas;
+    list_init(&vm_areas);
+    uint32_t entry;
+    int32_t loaded = load_elf(fd2file(fd)->fd_inode, &vm_areas, &entry);
+    sys_close(fd);      // 各区间自己持有 inode
+    if (loaded != 0) {
+        goto fail;
+    }
+
+    /* 到这里新映像已确定可以装入，开始替换 */
+    vma_release_all(&cur->vm_areas);
+    user_space_release(cur);
+    while (!list_empty(&vm_areas)) {
+        struct vm_area* vma = elem2entry(struct vm_area, tag, list_pop(&vm_areas));
+        vma_reserve(cur, vma);
+        list_append(&cur->vm_areas, &vma->tag);
+    }
+    char* name = strrchr(kpath, '/');
+    name = name == NULL ? kpath : name + 1;
+    memset(cur->name, 0, sizeof(cur->name));
+    memcpy(cur->name, name, strlen(name) < sizeof(cur->name) - 1 ? strlen(name) : sizeof(cur->name) - 1);
+
+    // 栈页沿用原来的，自顶向下放参数字符串、argv 数组、argv、argc 和假的返回地址
+    if (!page_present(USER_STACK3_VADDR) && get_one_page(PF_USER, USER_STACK3_VADDR) == NULL) {
+        PANIC("execv: no memory for user stack");
+    }
+    memset((void*)USER_STACK3_VADDR, 0, PG_SIZE);
+    char* strs = (char*)((USER_STACK3_VADDR + PG_SIZE - arg_bytes) & ~3);
+    memcpy(strs, args, arg_bytes);
+    uint32_t* sp = (uint32_t*)strs - (argc + 1);
+    char* arg = strs;
+    for (int32_t i = 0; i < argc; i++) {
+        sp[i] = (uint32_t)arg;
+        arg += strlen(arg) + 1;
+    }
+    sp[argc] = 0;
+    uint32_t argv_addr = (uint32_t)sp;
+    *(--sp) = argv_addr;
+    *(--sp) = argc;
+    *(--sp) = 0;
+    kfree(kpath);
+    kfree(args);
+
+    // 伪造中断返回现场，从 intr_exit 回到 3 级的入口。现场放在本函数栈上即可，intr_exit 只管从 esp 弹出
+    struct intr_stack frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.gs = 0;
+    frame.ds = frame.es = frame.fs = SELECTOR_U_DATA;
+    frame.eip = (void (*)(void))entry;
+    frame.cs = SELECTOR_U_CODE;
+    frame.eflags = (EFLAGS_IOPL_0 | EFLAGS_MBS | EFLAGS_IF_1);
+    frame.esp = sp;
+    frame.ss = SELECTOR_U_DATA;
+    intr_disable();
+    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&frame) : "memory");
+    return -1;
+
+fail:
+    if (kpath != NULL) {
+        kfree(kpath);
+    }
+    if (args != NULL) {
+        kfree(args);
+    }
+    return -1;
+}
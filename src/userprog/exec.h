@@ -0,0 +1,22 @@
+#ifndef __USERPROG_EXEC_H
+#define __USERPROG_EXEC_H
+#include "stdint.h"
+#include "list.h"
+#include "global.h"
+
+struct inode;
+
+/* 按需从文件加载的一段用户地址，对应 ELF 的一个 PT_LOAD 段 */
+struct vm_area {
+    struct list_elem tag;       // 进程 vm_areas 链表中的结点
+    uint32_t start;             // 页对齐的区间 [start, end)
+    uint32_t end;
+    struct inode* inode;        // 后备文件，持有一次打开计数
+    uint32_t file_off;          // start 对应的文件偏移
+    uint32_t file_bytes;        // 从 start 起有多少字节来自文件，其余填 0 (.bss)
+};
+
+bool vma_fault(uint32_t vaddr);
+int32_t sys_execv(const char* path, char* const argv[]);
+
+#endif
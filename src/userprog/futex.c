@@ -0,0 +1,83 @@
+#include "futex.h"
+#include "thread.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "list.h"
+#include "print.h"
+#include "global.h"
+
+/* 睡在某个 futex 上的线程，结点就在它自己的内核栈上 */
+struct futex_waiter {
+    struct list_elem tag;       // 哈希桶中的结点
+    uint32_t paddr;             // futex 字的物理地址
+    struct task_struct* thread;
+};
+
+/* 以 futex 字的物理地址为键的等待队列，不同进程映射到同一物理页时也能互相唤醒 */
+static struct list futex_queues[FUTEX_HASH_SIZE];
+
+static struct list* futex_bucket(uint32_t paddr) {
+    return &futex_queues[(paddr >> 2) & (FUTEX_HASH_SIZE - 1)];
+}
+
+/** uaddr 是否为已映射的、4 字节对齐的用户地址，是则返回其物理地址，否则返回 0 */
+static uint32_t futex_paddr(uint32_t* uaddr) {
+    uint32_t vaddr = (uint32_t)uaddr;
+    if (vaddr % 4 != 0 || vaddr >= KERNEL_SPACE) {
+        return 0;
+    }
+    if (!(*pde_ptr(vaddr) & PG_P_1) || !(*pte_ptr(vaddr) & PG_P_1)) {
+        return 0;
+    }
+    return addr_v2p(vaddr);
+}
+
+/** *uaddr 仍等于 val 时睡眠，直到被 futex_wake 唤醒。被唤醒返回 0，值已改变或地址非法返回 -1 */
+int32_t sys_futex_wait(uint32_t* uaddr, uint32_t val) {
+    enum intr_status old_status = intr_disable();
+    uint32_t paddr = futex_paddr(uaddr);
+    // 比较和入队在关中断下完成，不会漏掉比较之后、睡眠之前的唤醒
+    if (paddr == 0 || *uaddr != val) {
+        intr_set_status(old_status);
+        return -1;
+    }
+    struct futex_waiter waiter;
+    waiter.paddr = paddr;
+    waiter.thread = running_thread();
+    list_append(futex_bucket(paddr), &waiter.tag);
+    thread_block(TASK_BLOCKED);
+    intr_set_status(old_status);
+    return 0;
+}
+
+/** 唤醒最多 nr_wake 个睡在 uaddr 上的线程，返回唤醒的个数，地址非法返回 -1 */
+int32_t sys_futex_wake(uint32_t* uaddr, uint32_t nr_wake) {
+    enum intr_status old_status = intr_disable();
+    uint32_t paddr = futex_paddr(uaddr);
+    if (paddr == 0) {
+        intr_set_status(old_status);
+        return -1;
+    }
+    struct list* bucket = futex_bucket(paddr);
+    struct list_elem* elem = bucket->head.next;
+    int32_t nr_woken = 0;
+    while (elem != &bucket->tail && (uint32_t)nr_woken < nr_wake) {
+        struct futex_waiter* waiter = elem2entry(struct futex_waiter, tag, elem);
+        elem = elem->next;
+        if (waiter->paddr == paddr) {
+            list_remove(&waiter->tag);
+            thread_unblock(waiter->thread);
+            nr_woken++;
+        }
+    }
+    intr_set_status(old_status);
+    return nr_woken;
+}
+
+void futex_init(void) {
+    put_str("   futex_init start...\n");
+    for (uint32_t idx = 0; idx < FUTEX_HASH_SIZE; idx++) {
+        list_init(&futex_queues[idx]);
+    }
+    put_str("   futex_init done!\n");
+}
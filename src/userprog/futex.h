@@ -0,0 +1,11 @@
+#ifndef __USERPROG_FUTEX_H
+#define __USERPROG_FUTEX_H
+#include "stdint.h"
+
+#define FUTEX_HASH_SIZE     64      // 等待队列哈希桶个数，须为 2 的幂
+
+void    futex_init(void);
+int32_t sys_futex_wait(uint32_t* uaddr, uint32_t val);
+int32_t sys_futex_wake(uint32_t* uaddr, uint32_t nr_wake);
+
+#endif
@@ -46,9 +46,7 @@ void start_process(void* filename_) {
 
 /* 激活页表 */
 inline void page_dir_activate(struct task_struct* p_thread) {
-    // TODO: - 用户级新创建的线程 页表为空，需要完善，这里需要完全重写 
-    // 思考： 每个task struct 都有 pgdir，线程创建时 值同当前进程（内核线程除外）
-
+    // 用户进程内的线程创建时 pgdir 取自 leader，与进程用同一张页表
     // 若为内核线程，页表地址 0x100000
     uint32_t pagedir_phy_addr = 0x100000;  
     if (p_thread->pgdir != NULL)    {   
@@ -61,9 +59,14 @@ inline void page_dir_activate(struct task_struct* p_thread) {
 
 /* 激活线程或进程的页表,更新tss中的esp0为进程的特权级0的栈 */
 void process_activate(struct task_struct* p_thread) {
-   
-    // 激活该进程或线程的页表
-    page_dir_activate(p_thread);
+    struct run_queue* rq = this_rq();
+    // 内核线程只用高 1GB，所有页表的这部分都相同，借用上一个任务的页表即可 (lazy TLB)；
+    // 同一进程的线程页表相同。这两种情况都不写 cr3，免得白白刷掉 TLB
+    if (p_thread->pgdir != NULL && p_thread->pgdir != rq->active_pgdir) {
+        page_dir_activate(p_thread);
+        rq->active_pgdir = p_thread->pgdir;
+        rq->nr_cr3_loads++;
+    }
     
     // 内核级任务中断后直接用当时的栈，不会从tss中获取0特权级栈地址。可以更新esp0，但没必要
     // 加了用户任务之后，为了区分内核任务，再想条件判断
@@ -118,8 +121,7 @@ void process_execute(void* filename, char* name) {
     thread_create(thread, start_process, filename);
 
     enum intr_status old_status = intr_disable();
-    ASSERT(!elem_find(&thread_ready_list, &thread->general_tag));
-    list_append(&thread_ready_list, &thread->general_tag);
+    thread_ready_append(thread);
     
     ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
     list_append(&thread_all_list, &thread->all_list_tag);
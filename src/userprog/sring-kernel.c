@@ -0,0 +1,210 @@
+#include "sring-kernel.h"
+#include "syscall-init.h"
+#include "uaccess.h"
+#include "thread.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "sync.h"
+#include "timer.h"
+#include "fs.h"
+#include "global.h"
+#include "debug.h"
+
+/* 进程的提交环，内核私有的部分。共享页中的下标用户可以随意改写，内核只信自己记录的位置 */
+struct sring_ctx {
+    struct sring* ring;             // 与用户共享的一页
+    uint32_t sq_head;               // 下一个要取的提交项
+    uint32_t cq_tail;               // 下一个要写的完成项
+    struct mutex_t submit_lock;     // 非轮询模式下同一进程的多个线程可能同时提交
+    struct task_struct* poller;     // 轮询线程，非轮询模式为 NULL
+    bool poller_sleeping;
+    struct wait_queue cq_wait;      // 轮询模式下等待完成项的线程
+};
+
+/** 执行一个提交项，返回值写入完成项。参数的检查与对应的系统调用相同 */
+static int32_t sring_do_op(struct sring_sqe* sqe) {
+    struct task_struct* leader = running_thread()->leader;
+    switch (sqe->opcode) {
+        case SRING_OP_NOP:
+            return 0;
+        case SRING_OP_WRITE:
+            return sys_write((char*)sqe->addr);
+        case SRING_OP_OPEN: {
+            // 路径可能很长，不放在内核栈上
+            char* path = kmalloc(MAX_PATH_LEN);
+            if (path == NULL) {
+                return -1;
+            }
+            int32_t len = strncpy_from_user(path, (const char*)sqe->addr, MAX_PATH_LEN);
+            int32_t fd = -1;
+            if (len > 0 && len < MAX_PATH_LEN) {
+                fd = sys_open(path, (uint8_t)sqe->len);
+            }
+            kfree(path);
+            return fd;
+        }
+        case SRING_OP_CLOSE:
+            if (sqe->fd < 0 || sqe->fd >= MAX_FILES_OPEN_PER_PROC || leader->fd_table[sqe->fd] == -1) {
+                return -1;
+            }
+            return sys_close(sqe->fd);
+        case SRING_OP_MALLOC:
+            return (int32_t)sys_malloc(sqe->len);
+        case SRING_OP_READ:
+            return sys_read(sqe->fd, (void*)sqe->addr, sqe->len);
+        case SRING_OP_FREE:
+            if (sqe->addr == 0) {
+                return -1;
+            }
+            sys_free((void*)sqe->addr);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/** 从提交队列取至多 max 项执行并写入完成项，完成队列满时停下。返回处理的项数 */
+static uint32_t sring_consume(struct sring_ctx* ctx, uint32_t max) {
+    struct sring* ring = ctx->ring;
+    uint32_t done = 0;
+    while (done < max) {
+        uint32_t sq_tail = ring->sq_tail;
+        // 队列空，或者 tail 被改成了不可能的值
+        if (sq_tail == ctx->sq_head || sq_tail - ctx->sq_head > SRING_ENTRIES) {
+            break;
+        }
+        if (ctx->cq_tail - ring->cq_head >= SRING_ENTRIES) {
+            break;
+        }
+        sring_barrier();
+        // 先复制出来，执行过程中用户改写提交项不影响内核
+        struct sring_sqe sqe = ring->sqes[ctx->sq_head & SRING_MASK];
+        ring->sq_head = ++ctx->sq_head;
+
+        int32_t res = sring_do_op(&sqe);
+        struct sring_cqe* cqe = &ring->cqes[ctx->cq_tail & SRING_MASK];
+        cqe->user_data = sqe.user_data;
+        cqe->res = res;
+        sring_barrier();            // 完成项写完之后才能发布 tail
+        ring->cq_tail = ++ctx->cq_tail;
+        done++;
+    }
+    if (done != 0 && ctx->poller != NULL) {
+        wake_up_all(&ctx->cq_wait);
+    }
+    return done;
+}
+
+/** 轮询线程：不断处理提交队列，空闲超过 SQPOLL_IDLE_MS 后置 SRING_NEED_WAKEUP 睡眠 */
+static void sring_poller(void* arg) {
+    struct sring_ctx* ctx = arg;
+    struct sring* ring = ctx->ring;
+    uint32_t idle_ticks = ms_to_ticks(SQPOLL_IDLE_MS);
+    uint32_t last_active = ticks;
+    while (1) {
+        if (sring_consume(ctx, SRING_ENTRIES) != 0) {
+            last_active = ticks;
+            continue;
+        }
+        if (ticks - last_active < idle_ticks) {
+            thread_yield();
+            continue;
+        }
+        enum intr_status old_status = intr_disable();
+        ring->flags |= SRING_NEED_WAKEUP;
+        // 置标志后再看一次，用户在此之前发布的请求不会因没有唤醒而搁置
+        if (ring->sq_tail == ctx->sq_head) {
+            ctx->poller_sleeping = true;
+            thread_block(TASK_BLOCKED);
+        }
+        ring->flags &= ~SRING_NEED_WAKEUP;
+        intr_set_status(old_status);
+        last_active = ticks;
+    }
+}
+
+/** 创建和当前进程共用页表、堆和文件描述符的内核线程，在进程上下文中执行请求 */
+static struct task_struct* poller_create(struct sring_ctx* ctx) {
+    struct task_struct* cur = running_thread();
+    struct task_struct* thread = get_pages(1, PF_KERNEL);
+    if (thread == NULL) {
+        return NULL;
+    }
+    init_thread(thread, "sqpoll", cur->leader->base_priority);
+    thread->leader = cur->leader;
+    thread->pgdir = cur->pgdir;
+    thread_create(thread, sring_poller, ctx);
+
+    enum intr_status old_status = intr_disable();
+    thread_ready_append(thread);
+    ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
+    list_append(&thread_all_list, &thread->all_list_tag);
+    intr_set_status(old_status);
+    return thread;
+}
+
+/** 为当前进程建立提交环，返回共享页的地址，失败返回 NULL。
+ * 共享页分在内核空间，页表项带 U 位，所有地址空间和轮询线程都能访问。每个进程只有一个环 */
+struct sring* sys_sring_setup(uint32_t flags) {
+    struct task_struct* leader = running_thread()->leader;
+    if (running_thread()->pgdir == NULL || leader->ring != NULL) {
+        return NULL;
+    }
+    struct sring_ctx* ctx = kmalloc(sizeof(struct sring_ctx));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    struct sring* ring = get_pages(1, PF_KERNEL);
+    if (ring == NULL) {
+        kfree(ctx);
+        return NULL;
+    }
+    ctx->ring = ring;
+    ctx->sq_head = ctx->cq_tail = 0;
+    mutex_init(&ctx->submit_lock);
+    ctx->poller = NULL;
+    ctx->poller_sleeping = false;
+    wait_queue_init(&ctx->cq_wait);
+    ring->flags = flags & SRING_SQPOLL;
+
+    if (flags & SRING_SQPOLL) {
+        ctx->poller = poller_create(ctx);
+        if (ctx->poller == NULL) {
+            free_pages(ring, 1, PF_KERNEL);
+            kfree(ctx);
+            return NULL;
+        }
+    }
+    leader->ring = ctx;
+    return ring;
+}
+
+/** 非轮询模式下执行至多 to_submit 个提交项，返回执行的项数；
+ * 轮询模式下唤醒轮询线程，并等到至少有 min_complete 个未处理的完成项，返回 0。未建立环返回 -1 */
+int32_t sys_sring_enter(uint32_t to_submit, uint32_t min_complete) {
+    struct sring_ctx* ctx = running_thread()->leader->ring;
+    if (ctx == NULL) {
+        return -1;
+    }
+    if (ctx->poller == NULL) {
+        // 请求都是同步执行的，返回时已全部完成，无需等待
+        mutex_lock(&ctx->submit_lock);
+        int32_t submitted = sring_consume(ctx, to_submit);
+        mutex_unlock(&ctx->submit_lock);
+        return submitted;
+    }
+
+    if (min_complete > SRING_ENTRIES) {
+        min_complete = SRING_ENTRIES;
+    }
+    enum intr_status old_status = intr_disable();
+    if (ctx->poller_sleeping) {
+        ctx->poller_sleeping = false;
+        thread_unblock(ctx->poller);
+    }
+    while (ctx->cq_tail - ctx->ring->cq_head < min_complete) {
+        wait_queue_sleep(&ctx->cq_wait, 0);
+    }
+    intr_set_status(old_status);
+    return 0;
+}
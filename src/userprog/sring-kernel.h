@@ -0,0 +1,11 @@
+#ifndef __USERPROG_SRING_KERNEL_H
+#define __USERPROG_SRING_KERNEL_H
+#include "stdint.h"
+#include "sring.h"
+
+#define SQPOLL_IDLE_MS 20           // 轮询线程空转这么久没有新请求就睡眠
+
+struct sring* sys_sring_setup(uint32_t flags);
+int32_t sys_sring_enter(uint32_t to_submit, uint32_t min_complete);
+
+#endif
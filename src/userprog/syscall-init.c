@@ -5,30 +5,150 @@
 #include "console.h"
 #include "string.h"
 #include "memory.h"
+#include "trace.h"
+#include "uthread.h"
+#include "futex.h"
+#include "sring-kernel.h"
+#include "exec.h"
+#include "fs.h"
+#include "uaccess.h"
+#include "cpu.h"
+#include "debug.h"
+#include "stdio-kernel.h"
+#include "iostat.h"
 
 #define syscall_nr 32 
+#define SYSCALL_MAX_ARGS 5          // ebx ecx edx esi edi，ebp 在 sysenter 中用来传用户栈
+#define SYSCALL_HIST_BUCKETS 16     // 延迟直方图：第 i 格为 [2^(i+6), 2^(i+7)) 个周期，两端的格子兼收越界值
+#define SYSCALL_HIST_SHIFT 6
+#define WRITE_CHUNK 64              // sys_write 每次从用户空间复制的字节数
 
-typedef void* syscall;
-syscall syscall_table[syscall_nr];
+/* 统一按 5 个参数调用，cdecl 下调用方清栈，处理函数用不到的参数无害 */
+typedef int32_t (*syscall)(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
 
-/* 返回当前任务的pid */
+/* 系统调用表项，带参数个数和调用统计 */
+struct syscall_entry {
+    syscall handler;
+    const char* name;
+    uint8_t argc;
+    uint32_t nr_calls;
+    uint64_t total_tsc;                     // 累计周期数，会阻塞的调用包含睡眠时间
+    uint32_t latency_hist[SYSCALL_HIST_BUCKETS];
+};
+
+static struct syscall_entry syscall_table[syscall_nr];
+
+/* 返回当前任务所属进程的pid */
 uint32_t sys_getpid() {
-    return running_thread()->pid;
+    return running_thread()->leader->pid;
+}
+
+/** 分块复制用户字符串并输出，返回输出的字节数，地址非法返回 -1 */
+int32_t sys_write(char* str) {
+    char buf[WRITE_CHUNK + 1];
+    int32_t written = 0;
+    while (1) {
+        int32_t len = strncpy_from_user(buf, str + written, WRITE_CHUNK);
+        if (len < 0) {
+            return written == 0 ? -1 : written;
+        }
+        buf[len] = '\0';
+        console_put_str(buf);
+        written += len;
+        if (len < WRITE_CHUNK) {
+            return written;
+        }
+    }
+}
+
+/** 打印各系统调用的调用次数、平均周期数和延迟直方图 */
+void sys_syscall_stats(void) {
+    printk("NAME(ARGC) CALLS AVG_CYCLES LOG2_CYCLES:COUNT...\n");
+    for (uint32_t nr = 0; nr < syscall_nr; nr++) {
+        struct syscall_entry* entry = &syscall_table[nr];
+        if (entry->handler == NULL || entry->nr_calls == 0) {
+            continue;
+        }
+        // 32 位内核没有 64 位除法，累计值超出 32 位时改用移位近似
+        uint64_t total = entry->total_tsc;
+        uint32_t calls = entry->nr_calls;
+        while (total >> 32) {
+            total >>= 1;
+            calls = (calls >> 1) | 1;
+        }
+        printk("%s(%d) %u %u", entry->name, entry->argc, entry->nr_calls, (uint32_t)total / calls);
+        for (uint32_t i = 0; i < SYSCALL_HIST_BUCKETS; i++) {
+            if (entry->latency_hist[i] != 0) {
+                printk(" %d:%u", i + SYSCALL_HIST_SHIFT, entry->latency_hist[i]);
+            }
+        }
+        printk("\n");
+    }
+}
+
+/** 周期数所在的直方图格子 */
+static uint32_t latency_bucket(uint32_t cycles) {
+    if (cycles == 0) {
+        return 0;
+    }
+    uint32_t log2;
+    asm ("bsr %1, %0" : "=r" (log2) : "rm" (cycles));
+    if (log2 < SYSCALL_HIST_SHIFT) {
+        return 0;
+    }
+    log2 -= SYSCALL_HIST_SHIFT;
+    return log2 < SYSCALL_HIST_BUCKETS ? log2 : SYSCALL_HIST_BUCKETS - 1;
+}
+
+/** int 0x80 和 sysenter 的公共入口：检查调用号，调用处理函数并记录耗时。
+ * 参数依次来自 ebx ecx edx esi edi。
+ * 两个入口都开着中断调用这里，处理函数可以被抢占、可以睡眠，需要原子性的自己关中断 */
+int32_t syscall_dispatch(uint32_t nr, uint32_t arg1, uint32_t arg2, 
+                         uint32_t arg3, uint32_t arg4, uint32_t arg5) {
+    if (nr >= syscall_nr || syscall_table[nr].handler == NULL) {
+        return -1;
+    }
+    struct syscall_entry* entry = &syscall_table[nr];
+    uint64_t start = rdtsc();
+    int32_t retval = entry->handler(arg1, arg2, arg3, arg4, arg5);
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+
+    // 线程退出类调用不会返回到这里，不计入统计
+    entry->nr_calls++;
+    entry->total_tsc += cycles;
+    entry->latency_hist[latency_bucket(cycles)]++;
+    return retval;
 }
 
-uint32_t sys_write(char* str) {
-	console_put_str(str);
-	return strlen(str);
+/* 登记调用号 nr 的处理函数及其参数个数 */
+static void syscall_register(uint32_t nr, void* handler, uint8_t argc, const char* name) {
+    ASSERT(nr < syscall_nr && argc <= SYSCALL_MAX_ARGS);
+    syscall_table[nr].handler = (syscall)handler;
+    syscall_table[nr].argc = argc;
+    syscall_table[nr].name = name;
 }
 
 /* 初始化系统调用 */
 void syscall_init(void) {
     put_str("   syscall_init start...\n");
 
-    syscall_table[SYS_GETPID] = sys_getpid;
-    syscall_table[SYS_WRITE]  = sys_write;
-    syscall_table[SYS_MALLOC] = sys_malloc;
-    syscall_table[SYS_FREE] = sys_free;
+    syscall_register(SYS_GETPID, sys_getpid, 0, "getpid");
+    syscall_register(SYS_WRITE, sys_write, 1, "write");
+    syscall_register(SYS_MALLOC, sys_malloc, 1, "malloc");
+    syscall_register(SYS_FREE, sys_free, 1, "free");
+    syscall_register(SYS_PS, sys_ps, 1, "ps");
+    syscall_register(SYS_THREAD_CREATE, sys_thread_create, 3, "thread_create");
+    syscall_register(SYS_THREAD_JOIN, sys_thread_join, 2, "thread_join");
+    syscall_register(SYS_THREAD_EXIT, sys_thread_exit, 1, "thread_exit");
+    syscall_register(SYS_FUTEX_WAIT, sys_futex_wait, 2, "futex_wait");
+    syscall_register(SYS_FUTEX_WAKE, sys_futex_wake, 2, "futex_wake");
+    syscall_register(SYS_SYSCALL_STATS, sys_syscall_stats, 0, "syscall_stats");
+    syscall_register(SYS_SRING_SETUP, sys_sring_setup, 1, "sring_setup");
+    syscall_register(SYS_SRING_ENTER, sys_sring_enter, 2, "sring_enter");
+    syscall_register(SYS_READ, sys_read, 3, "read");
+    syscall_register(SYS_EXECV, sys_execv, 2, "execv");
+    syscall_register(SYS_DISK_STATS, sys_disk_stats, 0, "disk_stats");
+    futex_init();
 
     put_str("   syscall_init done!\n");
 }
@@ -3,9 +3,13 @@
 #include "stdint.h"
 
 void syscall_init(void);
+int32_t syscall_dispatch(uint32_t nr, uint32_t arg1, uint32_t arg2, 
+                         uint32_t arg3, uint32_t arg4, uint32_t arg5);
 
 uint32_t sys_getpid(void);
 
-uint32_t sys_write(char* str);
+int32_t sys_write(char* str);
+
+void sys_syscall_stats(void);
 
 #endif
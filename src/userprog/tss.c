@@ -3,6 +3,9 @@
 #include "global.h"
 #include "string.h"
 #include "print.h"
+#include "cpu.h"
+
+extern void sysenter_entry(void);
 
 /* 任务状态段tss结构 */
 struct tss {
@@ -79,10 +82,26 @@ void tss_init() {
     *((struct gdt_desc*)(tss_desc+8)) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_CODE_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
     *((struct gdt_desc*)(tss_desc+8*2)) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
     
+    /* 为 sysenter/sysexit 在第 7～10 项依次添加 内核代码段、内核数据段、用户代码段、用户数据段 */
+    *((struct gdt_desc*)(tss_desc+8*3)) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_CODE_ATTR_LOW_DPL0, GDT_ATTR_HIGH);
+    *((struct gdt_desc*)(tss_desc+8*4)) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL0, GDT_ATTR_HIGH);
+    *((struct gdt_desc*)(tss_desc+8*5)) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_CODE_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+    *((struct gdt_desc*)(tss_desc+8*6)) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+    
     /* gdt 16位的limit 32位的段基址 */
-    uint64_t gdt_operand = ((8 * 7 - 1) | ((uint64_t)(uint32_t)(KERNEL_SPACE + GDT_BASE_ADDR) << 16));   // 7个描述符大小
+    uint64_t gdt_operand = ((8 * 11 - 1) | ((uint64_t)(uint32_t)(KERNEL_SPACE + GDT_BASE_ADDR) << 16));   // 11个描述符大小
     asm volatile ("lgdt %0" : : "m" (gdt_operand));
     asm volatile ("ltr %w0" : : "r" (SELECTOR_TSS));
+    
+    /* 支持的话开启 sysenter。esp 指向 tss.esp0，入口处再从中取出当前任务的内核栈 */
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (edx & CPUID_EDX_SEP) {
+        wrmsr(MSR_SYSENTER_CS, SELECTOR_SYSENTER_CS);
+        wrmsr(MSR_SYSENTER_ESP, (uint32_t)&tss.esp0);
+        wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+        put_str("   sysenter enabled\n");
+    }
     put_str("   tss_init and ltr done!\n");
 }
 
@@ -0,0 +1,109 @@
+#include "uaccess.h"
+#include "thread.h"
+#include "global.h"
+
+/* 演示用的用户程序链接在内核映像中，映像位于内核空间低端 1M，页表项带 U 位 */
+#define KERNEL_IMAGE_END (KERNEL_SPACE + 0x100000)
+
+// 链接器为 ex_table 段生成的起止符号
+extern struct exception_entry __start_ex_table[], __stop_ex_table[];
+
+/** [uaddr, uaddr+size) 能否作为当前任务传入的用户缓冲区。
+ * 内核线程可以传内核地址；用户进程只能用用户空间，另外可以读内核映像中的用户程序常量。
+ * 只检查范围，页是否存在由缺页时的异常修复处理 */
+bool access_ok(const void* uaddr, uint32_t size, bool write) {
+    uint32_t start = (uint32_t)uaddr;
+    uint32_t end = start + size;
+    if (end < start) {
+        return false;
+    }
+    if (running_thread()->pgdir == NULL || end <= KERNEL_SPACE) {
+        return true;
+    }
+    return !write && start >= KERNEL_SPACE && end <= KERNEL_IMAGE_END;
+}
+
+/** 先按 4 字节再按字节复制，返回未能复制的字节数。
+ * 两条 rep 指令都登记在异常修复表中，缺页时 ecx 正是剩余的次数 */
+static uint32_t __copy_user(void* to, const void* from, uint32_t n) {
+    uint32_t d0, d1;
+    asm volatile (
+        "1: rep movsl\n\t"
+        "mov %3, %%ecx\n"
+        "2: rep movsb\n"
+        "3:\n"
+        ".section .fixup, \"ax\"\n"
+        "4: lea (%3, %%ecx, 4), %%ecx\n\t"
+        "jmp 3b\n"
+        ".previous\n"
+        ".section ex_table, \"a\"\n"
+        ".long 1b, 4b\n"
+        ".long 2b, 3b\n"
+        ".previous"
+        : "=&c" (n), "=&D" (d0), "=&S" (d1)
+        : "r" (n & 3), "0" (n / 4), "1" (to), "2" (from)
+        : "memory"
+    );
+    return n;
+}
+
+/** 从用户空间 from 复制 n 字节到内核 to，返回未能复制的字节数，0 表示成功 */
+uint32_t copy_from_user(void* to, const void* from, uint32_t n) {
+    if (!access_ok(from, n, false)) {
+        return n;
+    }
+    return __copy_user(to, from, n);
+}
+
+/** 从内核 from 复制 n 字节到用户空间 to，返回未能复制的字节数，0 表示成功 */
+uint32_t copy_to_user(void* to, const void* from, uint32_t n) {
+    if (!access_ok(to, n, true)) {
+        return n;
+    }
+    return __copy_user(to, from, n);
+}
+
+/** 复制用户字符串到 dst，最多 max 字节。
+ * 遇到 '\0' 返回字符串长度(dst 以 '\0' 结尾)，max 字节内没有结尾返回 max，地址非法返回 -1 */
+int32_t strncpy_from_user(char* dst, const char* src, uint32_t max) {
+    uint32_t i;
+    for (i = 0; i < max; i++) {
+        if (!access_ok(src + i, 1, false)) {
+            return -1;
+        }
+        char c;
+        int32_t err;
+        // 读之前先置错误码，读成功才清零；缺页时跳过清零
+        asm volatile (
+            "movl $-1, %1\n"
+            "1: movb (%2), %0\n\t"
+            "movl $0, %1\n"
+            "2:\n"
+            ".section ex_table, \"a\"\n"
+            ".long 1b, 2b\n"
+            ".previous"
+            : "=&q" (c), "=&r" (err)
+            : "r" (src + i)
+        );
+        if (err) {
+            return -1;
+        }
+        dst[i] = c;
+        if (c == '\0') {
+            return i;
+        }
+    }
+    return max;
+}
+
+/** 内核态缺页时查异常修复表，出错指令在表中则改写返回地址到修复代码 */
+bool fixup_exception(struct intr_stack* frame) {
+    struct exception_entry* entry;
+    for (entry = __start_ex_table; entry < __stop_ex_table; entry++) {
+        if (entry->insn == (uint32_t)frame->eip) {
+            frame->eip = (void (*)(void))entry->fixup;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,20 @@
+#ifndef __USERPROG_UACCESS_H
+#define __USERPROG_UACCESS_H
+#include "stdint.h"
+#include "global.h"
+
+struct intr_stack;
+
+/* 异常修复表项：insn 处的指令访问用户内存出现缺页时，从 fixup 处继续执行 */
+struct exception_entry {
+    uint32_t insn;
+    uint32_t fixup;
+};
+
+bool access_ok(const void* uaddr, uint32_t size, bool write);
+uint32_t copy_from_user(void* to, const void* from, uint32_t n);
+uint32_t copy_to_user(void* to, const void* from, uint32_t n);
+int32_t  strncpy_from_user(char* dst, const char* src, uint32_t max);
+bool fixup_exception(struct intr_stack* frame);
+
+#endif
@@ -0,0 +1,116 @@
+#include "uthread.h"
+#include "uaccess.h"
+#include "thread.h"
+#include "process.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "global.h"
+#include "debug.h"
+
+extern void intr_exit(void);
+
+/** PCB 页顶部的中断栈，thread_create 为它预留了位置 */
+static struct intr_stack* pcb_intr_stack(struct task_struct* pthread) {
+    return (struct intr_stack*)((uint32_t)pthread + PG_SIZE - sizeof(struct intr_stack));
+}
+
+/** 新用户线程第一次上 cpu 时由 kernel_thread 调用：从 sys_thread_create 备好的中断栈返回 3 级 */
+static void start_uthread(__attribute__((unused)) void* arg) {
+    intr_disable();
+    struct intr_stack* proc_stack = pcb_intr_stack(running_thread());
+    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (proc_stack) : "memory");
+}
+
+/** 在当前进程中创建线程，从用户态的 entry(func, arg) 开始执行。
+ * 与进程共用页表、堆和文件描述符，有自己的内核栈和一页用户栈。成功返回线程号，失败返回 -1 */
+int32_t sys_thread_create(void* entry, void* func, void* arg) {
+    struct task_struct* cur = running_thread();
+    if (cur->pgdir == NULL) {
+        return -1;
+    }
+    struct task_struct* thread = get_pages(1, PF_KERNEL);
+    if (thread == NULL) {
+        return -1;
+    }
+    uint32_t* ustack = get_pages(1, PF_USER);   // 分在 leader 的虚拟地址池中
+    if (ustack == NULL) {
+        free_pages(thread, 1, PF_KERNEL);
+        return -1;
+    }
+    init_thread(thread, cur->name, cur->leader->base_priority);
+    thread->leader = cur->leader;
+    thread->pgdir = cur->pgdir;
+    thread->ustack = ustack;
+    thread_create(thread, start_uthread, NULL);
+
+    // 用户栈上伪造一次调用 entry(func, arg)，返回地址为 0，entry 自己调用 exit 不会返回
+    uint32_t* esp = (uint32_t*)((uint32_t)ustack + PG_SIZE);
+    *(--esp) = (uint32_t)arg;
+    *(--esp) = (uint32_t)func;
+    *(--esp) = 0;
+
+    struct intr_stack* proc_stack = pcb_intr_stack(thread);
+    proc_stack->edi = proc_stack->esi = proc_stack->ebp = proc_stack->esp_dummy = 0;
+    proc_stack->ebx = proc_stack->edx = proc_stack->ecx = proc_stack->eax = 0;
+    proc_stack->gs  = 0;
+    proc_stack->ds  = proc_stack->es = proc_stack->fs = SELECTOR_U_DATA;
+    proc_stack->eip = entry;
+    proc_stack->cs  = SELECTOR_U_CODE;
+    proc_stack->esp = esp;
+    proc_stack->ss  = SELECTOR_U_DATA;
+    proc_stack->eflags = (EFLAGS_IOPL_0 | EFLAGS_MBS | EFLAGS_IF_1);
+
+    enum intr_status old_status = intr_disable();
+    thread_ready_append(thread);
+    ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
+    list_append(&thread_all_list, &thread->all_list_tag);
+    intr_set_status(old_status);
+    return thread->pid;
+}
+
+/** 在本进程中找线程号为 tid 的线程 */
+static struct task_struct* find_uthread(int32_t tid) {
+    struct task_struct* leader = running_thread()->leader;
+    struct list_elem* elem = thread_all_list.head.next;
+    while (elem != &thread_all_list.tail) {
+        struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, elem);
+        if (pthread->pid == tid && pthread->leader == leader) {
+            return pthread;
+        }
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/** 等待本进程的线程 tid 退出，退出码存入 status(可为 NULL) 并回收其栈和 PCB。成功返回 0，失败返回 -1 */
+int32_t sys_thread_join(int32_t tid, int32_t* status) {
+    struct task_struct* cur = running_thread();
+    enum intr_status old_status = intr_disable();
+    struct task_struct* target = find_uthread(tid);
+    // leader 的 PCB 保存着整个进程共用的资源，不能被 join 回收
+    if (target == NULL || target == cur || target == target->leader || target->joiner != NULL) {
+        intr_set_status(old_status);
+        return -1;
+    }
+    if (target->status != TASK_DIED) {
+        target->joiner = cur;
+        thread_block(TASK_WAITING);
+    }
+    /* 单处理器下 target 在 schedule 里换下 cpu 之后本线程才可能运行，此时回收它是安全的 */
+    ASSERT(target->status == TASK_DIED);
+    list_remove(&target->all_list_tag);
+    intr_set_status(old_status);
+
+    int32_t exit_status = target->exit_status;
+    free_pages(target->ustack, 1, PF_USER);
+    free_pages(target, 1, PF_KERNEL);
+    if (status != NULL && copy_to_user(status, &exit_status, sizeof(exit_status)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/** 当前线程退出，退出码交给 join 它的线程 */
+void sys_thread_exit(int32_t status) {
+    thread_exit(status);
+}
@@ -0,0 +1,9 @@
+#ifndef __USERPROG_UTHREAD_H
+#define __USERPROG_UTHREAD_H
+#include "stdint.h"
+
+int32_t sys_thread_create(void* entry, void* func, void* arg);
+int32_t sys_thread_join(int32_t tid, int32_t* status);
+void    sys_thread_exit(int32_t status);
+
+#endif